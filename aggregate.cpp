@@ -0,0 +1,241 @@
+#include <climits>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "aggregate.h"
+
+using namespace std;
+
+namespace
+{
+    long long lift_one(int)
+    {
+        return 1;
+    }
+
+    long long lift_key(int key)
+    {
+        return key;
+    }
+
+    long long combine_add(long long a, long long b)
+    {
+        return a + b;
+    }
+
+    long long combine_min(long long a, long long b)
+    {
+        return b < a ? b : a;
+    }
+
+    long long combine_max(long long a, long long b)
+    {
+        return b > a ? b : a;
+    }
+
+    bool is_leaf(Node *node)
+    {
+        return node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF;
+    }
+
+    /** Recompute every child aggregate of an internal node from its
+      * children, whose own aggregates must be up to date.
+      */
+    void fill_aggregates(Node *node, const Monoid *monoid)
+    {
+        for (int i = 0; i <= node->get_keysize(); i++)
+        {
+            node->set_aggregate(subtree_aggregate(node->get_child()[i], monoid), i);
+        }
+    }
+} // namespace
+
+namespace Tree
+{
+    const Monoid MONOID_COUNT = {0, lift_one, combine_add};
+    const Monoid MONOID_SUM = {0, lift_key, combine_add};
+    const Monoid MONOID_MIN = {LLONG_MAX, lift_key, combine_min};
+    const Monoid MONOID_MAX = {LLONG_MIN, lift_key, combine_max};
+} // namespace Tree
+
+/** ************************************************************
+INPUT       : Root node pointer, monoid, nullptr to switch off
+OPERATION   : Augment the root and every internal node with monoid
+and compute all child aggregates bottom-up. From then on
+insert_node / delete_node keep them current, and split
+and join repair them, see repair_aggregates().
+************************************************************* */
+void enable_aggregates(Node *node, const Monoid *monoid)
+{
+    bool root = node->get_type() == TREE_ROOT_LEAF || node->get_type() == TREE_ROOT_INTERNAL;
+    if (is_leaf(node))
+    {
+        if (root)
+        { // kept on a root leaf, so the tree stays augmented once it splits
+            node->set_monoid(monoid);
+        }
+        return;
+    }
+    node->set_monoid(monoid);
+    for (int i = 0; i <= node->get_keysize(); i++)
+    {
+        enable_aggregates(node->get_child()[i], monoid);
+    }
+    if (monoid != nullptr)
+    {
+        fill_aggregates(node, monoid);
+    }
+}
+
+/** Fold of every key below node, from the keys of a leaf or the
+  * stored child aggregates of an internal node, which are computed
+  * first if node has not been augmented with monoid yet.
+  */
+long long subtree_aggregate(Node *node, const Monoid *monoid)
+{
+    long long result = monoid->identity;
+    if (is_leaf(node))
+    {
+        for (int i = 0; i < node->get_keysize(); i++)
+        {
+            result = monoid->combine(result, monoid->lift(node->get_key(i)));
+        }
+    }
+    else
+    {
+        if (node->get_monoid() != monoid)
+        { // not augmented yet, e.g. a piece built by split_tree
+            node->set_monoid(monoid);
+            fill_aggregates(node, monoid);
+        }
+        for (int i = 0; i <= node->get_keysize(); i++)
+        {
+            result = monoid->combine(result, node->get_aggregate(i));
+        }
+    }
+    return result;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, monoid the tree was augmented with
+OPERATION   : Augment the root again after split_tree / join_trees
+rebuilt it. Those leave every internal node they created
+or changed without a monoid, so only the boundary paths
+are recomputed, through subtree_aggregate(), and every
+untouched subtree keeps its aggregates.
+************************************************************* */
+void repair_aggregates(Node *node, const Monoid *monoid)
+{
+    node->set_monoid(nullptr);
+    if (is_leaf(node))
+    {
+        node->set_monoid(monoid);
+        return;
+    }
+    subtree_aggregate(node, monoid);
+}
+
+/** Recompute the aggregate of one child after a key below it changed
+  */
+void update_aggregate(Node *node, int index)
+{
+    const Monoid *monoid = node->get_monoid();
+    if (monoid != nullptr && !is_leaf(node))
+    {
+        node->set_aggregate(subtree_aggregate(node->get_child()[index], monoid), index);
+    }
+}
+
+/** ************************************************************
+INPUT       : internal node whose children were rearranged
+OPERATION   : After a split, merge or borrow among the children,
+recompute the aggregates of every internal child, which
+may have gained or lost grandchildren, augmenting the
+ones just created, then those of node itself.
+************************************************************* */
+void refresh_aggregates(Node *node)
+{
+    const Monoid *monoid = node->get_monoid();
+    if (monoid == nullptr || is_leaf(node))
+    {
+        return;
+    }
+    for (int i = 0; i <= node->get_keysize(); i++)
+    {
+        Node *child = node->get_child()[i];
+        if (!is_leaf(child))
+        {
+            if (child->get_monoid() != monoid)
+            {
+                child->set_monoid(monoid);
+            }
+            fill_aggregates(child, monoid);
+        }
+    }
+    fill_aggregates(node, monoid);
+}
+
+/** ************************************************************
+INPUT       : Root node pointer of an augmented tree, range [lo, hi]
+OPERATION   : Combine the stored aggregates of every child that lies
+inside the range, and descend only into the at most two
+children per level that straddle one of its ends.
+@return fold of the monoid over the keys in [lo, hi], 0 for
+a tree without aggregates.
+************************************************************* */
+long long range_aggregate(Node *node, int lo, int hi)
+{
+    const Monoid *monoid = node->get_monoid();
+    if (monoid == nullptr)
+    {
+        return 0;
+    }
+    return range_aggregate_node(node, monoid, lo, hi, INT_MIN, INT_MAX);
+}
+
+/** ************************************************************
+INPUT       : node, monoid, query range [lo, hi], bounds [low, high]
+given by the parent's separators
+OPERATION   : Recursive part of range_aggregate().
+@return fold of the monoid over the keys of node in [lo, hi].
+************************************************************* */
+long long range_aggregate_node(Node *node, const Monoid *monoid, int lo, int hi, long long low, long long high)
+{
+    long long result = monoid->identity;
+    if (is_leaf(node))
+    {
+        for (int i = 0; i < node->get_keysize(); i++)
+        {
+            int key = node->get_key(i);
+            if (key >= lo && key <= hi)
+            {
+                result = monoid->combine(result, monoid->lift(key));
+            }
+        }
+        return result;
+    }
+
+    int size = node->get_keysize();
+    for (int i = 0; i <= size; i++)
+    {
+        long long child_lo = i > 0 ? node->get_key(i - 1) : low;
+        long long child_hi = i < size ? node->get_key(i) : high;
+        if (child_lo > hi)
+        {
+            break;
+        }
+        if (child_hi < lo)
+        {
+            continue;
+        }
+        if (child_lo >= lo && child_hi <= hi)
+        { // whole subtree inside the range
+            result = monoid->combine(result, node->get_aggregate(i));
+        }
+        else
+        {
+            result = monoid->combine(result, range_aggregate_node(node->get_child()[i], monoid, lo, hi, child_lo, child_hi));
+        }
+    }
+    return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "node.h"
+
+namespace Tree
+{
+    /** A monoid folded over the keys of a tree.
+      *
+      * lift maps a key to a value, combine must be associative and
+      * identity neutral for it. An augmented tree keeps, in every
+      * internal node, the fold of each child's subtree, so a range
+      * aggregate combines O(log n) stored values plus the keys of the
+      * two boundary leaves instead of visiting every leaf.
+      */
+    struct Monoid
+    {
+        long long identity;
+        long long (*lift)(int key);
+        long long (*combine)(long long a, long long b);
+    };
+
+    extern const Monoid MONOID_COUNT;
+    extern const Monoid MONOID_SUM;
+    extern const Monoid MONOID_MIN; // LLONG_MAX for no key
+    extern const Monoid MONOID_MAX; // LLONG_MIN for no key
+} // namespace Tree
+
+using namespace Tree;
+
+void enable_aggregates(Node* node, const Monoid* monoid);
+
+long long subtree_aggregate(Node* node, const Monoid* monoid);
+
+void repair_aggregates(Node* node, const Monoid* monoid);
+
+void update_aggregate(Node* node, int index);
+
+void refresh_aggregates(Node* node);
+
+long long range_aggregate(Node* node, int lo, int hi);
+
+long long range_aggregate_node(Node* node, const Monoid* monoid, int lo, int hi, long long low, long long high);
@@ -0,0 +1,247 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "async-io.h"
+
+#ifdef BPT_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+#ifdef BPT_IO_URING
+namespace
+{
+    /** Ask the ring with IORING_REGISTER_PROBE whether the kernel knows
+      * IORING_OP_READ. Both came with Linux 5.6, so an older kernel
+      * fails the probe and gets the fallback.
+      */
+    bool read_supported(int ring)
+    {
+        const unsigned int OPS = 256;
+        vector<char> bytes(sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op), 0);
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(bytes.data());
+        if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, OPS) < 0)
+        {
+            return false;
+        }
+        return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    }
+} // namespace
+#endif
+
+namespace Tree
+{
+    /** Set up a ring for depth reads, or the pread fallback if the
+      * kernel does not allow one.
+      */
+    AsyncReader::AsyncReader(unsigned int depth)
+        : depth_(depth < 1 ? 1 : depth), in_flight_(0), ring_(-1), unsubmitted_(0),
+          sq_map_(nullptr), cq_map_(nullptr), sqe_map_(nullptr), sq_size_(0), cq_size_(0), sqe_size_(0)
+    {
+#ifdef BPT_IO_URING
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int ring = syscall(__NR_io_uring_setup, depth_, &params);
+        if (ring < 0)
+        {
+            return;
+        }
+        if (!read_supported(ring))
+        {
+            close(ring);
+            return;
+        }
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        { // both rings share one mapping
+            sq_size_ = cq_size_ = sq_size_ > cq_size_ ? sq_size_ : cq_size_;
+        }
+        sq_map_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+        cq_map_ = sq_map_;
+        if (sq_map_ != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP))
+        {
+            cq_map_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+        }
+        sqe_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqe_map_ = mmap(nullptr, sqe_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+        if (sq_map_ == MAP_FAILED || cq_map_ == MAP_FAILED || sqe_map_ == MAP_FAILED)
+        {
+            if (sq_map_ != MAP_FAILED)
+            {
+                munmap(sq_map_, sq_size_);
+            }
+            if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_)
+            {
+                munmap(cq_map_, cq_size_);
+            }
+            if (sqe_map_ != MAP_FAILED)
+            {
+                munmap(sqe_map_, sqe_size_);
+            }
+            sq_map_ = cq_map_ = sqe_map_ = nullptr;
+            close(ring);
+            return;
+        }
+
+        char *sq = static_cast<char *>(sq_map_);
+        char *cq = static_cast<char *>(cq_map_);
+        sq_head_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+        cqes_ = cq + params.cq_off.cqes;
+        sqes_ = sqe_map_;
+        depth_ = params.sq_entries < depth_ ? params.sq_entries : depth_;
+        ring_ = ring;
+#endif
+    }
+
+    AsyncReader::~AsyncReader()
+    {
+        vector<pair<unsigned long, int>> done;
+        while (in_flight_ > 0)
+        { // the kernel may still write into the callers' buffers
+            wait(done, 1);
+        }
+        close_ring();
+    }
+
+    /** Unmap and close the ring, later reads take the fallback
+      */
+    void AsyncReader::close_ring()
+    {
+#ifdef BPT_IO_URING
+        if (ring_ >= 0)
+        {
+            munmap(sqe_map_, sqe_size_);
+            if (cq_map_ != sq_map_)
+            {
+                munmap(cq_map_, cq_size_);
+            }
+            munmap(sq_map_, sq_size_);
+            close(ring_);
+            ring_ = -1;
+            unsubmitted_ = 0;
+        }
+#endif
+    }
+
+    /** ************************************************************
+    INPUT       : file, target buffer, length and offset of the read,
+    tag handed back on completion
+    OPERATION   : Queue a read. It is passed to the kernel with the
+    next wait(); the buffer must stay valid until then.
+    @return false if depth reads are already in flight.
+    ************************************************************* */
+    bool AsyncReader::submit(int fd, void *buffer, unsigned int length, long long offset, unsigned long tag)
+    {
+        if (in_flight_ >= depth_)
+        {
+            return false;
+        }
+        in_flight_++;
+#ifdef BPT_IO_URING
+        if (ring_ >= 0)
+        {
+            unsigned int tail = *sq_tail_;
+            unsigned int index = tail & *sq_mask_;
+            io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes_) + index;
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->off = offset;
+            sqe->addr = reinterpret_cast<unsigned long>(buffer);
+            sqe->len = length;
+            sqe->user_data = tag;
+            sq_array_[index] = index;
+            __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+            unsubmitted_++;
+            return true;
+        }
+#endif
+        ssize_t result = pread(fd, buffer, length, offset);
+        ready_.push_back(make_pair(tag, result < 0 ? -errno : static_cast<int>(result)));
+        return true;
+    }
+
+    /** ************************************************************
+    INPUT       : output list, number of completions to wait for
+    OPERATION   : Submit the queued reads and collect finished ones as
+    (tag, bytes read or -errno) pairs. If io_uring_enter fails
+    for good, the ring is closed and the reads still in
+    flight are given up: none of them completes, and later
+    reads fall back to pread.
+    @return number of completions added to done, -errno if the
+    ring failed, with nothing added to done: every read in
+    flight is to be submitted again.
+    ************************************************************* */
+    int AsyncReader::wait(vector<pair<unsigned long, int>> &done, unsigned int min)
+    {
+        if (min > in_flight_)
+        {
+            min = in_flight_;
+        }
+        unsigned int count = 0;
+#ifdef BPT_IO_URING
+        if (ring_ >= 0)
+        {
+            while (unsubmitted_ > 0 || count < min)
+            {
+                unsigned int flags = count < min ? IORING_ENTER_GETEVENTS : 0;
+                int submitted = syscall(__NR_io_uring_enter, ring_, unsubmitted_, count < min ? 1 : 0, flags, nullptr, 0);
+                if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                    int error = errno;
+                    close_ring();
+                    done.resize(done.size() - count);
+                    in_flight_ = 0;
+                    return -error;
+                }
+                if (submitted > 0)
+                {
+                    unsubmitted_ -= submitted;
+                }
+
+                unsigned int head = *cq_head_;
+                while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+                {
+                    io_uring_cqe *cqe = static_cast<io_uring_cqe *>(cqes_) + (head & *cq_mask_);
+                    done.push_back(make_pair(static_cast<unsigned long>(cqe->user_data), cqe->res));
+                    head++;
+                    count++;
+                }
+                __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            }
+            in_flight_ -= count;
+            return count;
+        }
+#endif
+        done.insert(done.end(), ready_.begin(), ready_.end());
+        count = ready_.size();
+        ready_.clear();
+        in_flight_ -= count;
+        return count;
+    }
+
+    unsigned int AsyncReader::in_flight()
+    {
+        return in_flight_;
+    }
+
+    /** Check whether reads really run asynchronously
+      */
+    bool AsyncReader::uring()
+    {
+        return ring_ >= 0;
+    }
+} // namespace Tree
@@ -0,0 +1,63 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include) && !defined(BPT_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#define BPT_IO_URING
+#endif
+#endif
+
+namespace Tree
+{
+    /** Asynchronous positional reads.
+      *
+      * On Linux the reads go through an io_uring driven by raw system
+      * calls, so a single thread can keep up to depth reads in flight.
+      * Where io_uring is missing or refused at runtime, every read is
+      * done synchronously with pread at submission and only reported at
+      * the next wait(), so callers are written the same way either way.
+      * The ring is only used if the kernel reports IORING_OP_READ as
+      * supported. A ring that fails in wait() is closed, its reads in
+      * flight are lost and have to be submitted again, and the reader
+      * carries on with the fallback.
+      */
+    class AsyncReader
+    {
+    public:
+        AsyncReader(unsigned int depth);
+        ~AsyncReader();
+        AsyncReader(const AsyncReader &) = delete;
+        AsyncReader &operator=(const AsyncReader &) = delete;
+
+        bool submit(int fd, void *buffer, unsigned int length, long long offset, unsigned long tag);
+        int wait(std::vector<std::pair<unsigned long, int>> &done, unsigned int min);
+        unsigned int in_flight();
+        bool uring();
+
+    private:
+        void close_ring();
+
+        unsigned int depth_;
+        unsigned int in_flight_;
+        std::vector<std::pair<unsigned long, int>> ready_; // completed by the fallback
+
+        int ring_;             // io_uring descriptor, -1 for the fallback
+        unsigned int unsubmitted_;
+        void *sq_map_;
+        void *cq_map_;
+        void *sqe_map_;
+        unsigned long sq_size_;
+        unsigned long cq_size_;
+        unsigned long sqe_size_;
+        unsigned int *sq_head_;
+        unsigned int *sq_tail_;
+        unsigned int *sq_mask_;
+        unsigned int *sq_array_;
+        unsigned int *cq_head_;
+        unsigned int *cq_tail_;
+        unsigned int *cq_mask_;
+        void *cqes_;
+        void *sqes_;
+    };
+} // namespace Tree
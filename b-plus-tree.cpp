@@ -2,9 +2,17 @@
 #include <vector>
 #include <queue>
 #include <iomanip>
+#include <climits>
+#include <thread>
+#include <utility>
 
 #include "node.h"
 #include "b-plus-tree.h"
+#include "epoch.h"
+#include "stats.h"
+#include "aggregate.h"
+#include "fixed-capacity.h"
+#include "change-feed.h"
 
 using namespace std;
 
@@ -20,9 +28,18 @@ from bottom to top.
 ************************************************************* */
 void insert_node(Node *node, int key)
 {
+    bool is_root = node->get_type() == TREE_ROOT_LEAF || node->get_type() == TREE_ROOT_INTERNAL;
+    STAT_TIMER(STAT_OP_INSERT, is_root);
+    if (is_root)
+    {
+        write_begin(node); // serialize writers, make optimistic readers retry
+        feed_begin(node);
+    }
+
     if (node->get_type() == TREE_ROOT_LEAF)
     { // inserting when I'm at the root-leaf node
         node->add_key(key);
+        feed_record(FEED_INSERT, key);
 
         if (node->isFull())
         {
@@ -32,19 +49,14 @@ void insert_node(Node *node, int key)
     else if (node->get_type() == TREE_LEAF)
     { // inserting when I'm at the leaf
         node->add_key(key);
+        feed_record(FEED_INSERT, key);
     }
     else
     { // inserting when I'm at root-internal node or internal node
-        int i = 0;
-        for (int keys : node->get_keylist())
-        { // find index of proper child to dive into
-            if (key < keys)
-            {
-                break;
-            }
-            i++;
-        }
+        // find index of proper child to dive into
+        int i = key_rank<true>(node->get_keys(), node->get_keysize(), node->get_capacity(), key);
         insert_node(node->get_child()[i], key); // recursively dive into proper child
+        update_aggregate(node, i);
         if (node->get_child()[i]->isFull())
         {                         // [[CASE 3]] Child node is FULL.
             insert_arrange(node); // I'm not full, but child is full. arrange the tree..        // [[CASE 3 - 1]] child node is LEAF node..
@@ -54,6 +66,12 @@ void insert_node(Node *node, int key)
             insert_arrange(node); // my child is not full, but I'm full. arrange the tree..    // [[CASE 2]] ROOT - INTERNAL node is FULL
         }
     }
+
+    if (is_root)
+    {
+        feed_end();
+        write_end(node);
+    }
     return;
 }
 
@@ -67,22 +85,27 @@ from bottom to top.
 ************************************************************* */
 Node *delete_node(Node *node, int key)
 {
-    if (node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF)
+    bool is_root = node->get_type() == TREE_ROOT_LEAF || node->get_type() == TREE_ROOT_INTERNAL;
+    STAT_TIMER(STAT_OP_DELETE, is_root);
+    if (is_root)
     {
-        node->del_key(key); // deleting when I'm at the root-leaf node or leaf node
+        write_begin(node);
+        feed_begin(node);
+    }
+
+    if (node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF)
+    { // deleting when I'm at the root-leaf node or leaf node
+        if (node->del_key(key))
+        {
+            feed_record(FEED_ERASE, key);
+        }
     }
     else
     { // deleting when I'm at the root-internal node or internal node
-        int i = 0;
-        for (int keys : node->get_keylist())
-        { // find index of proper child to dive into
-            if (key < keys)
-            {
-                break;
-            }
-            i++;
-        }
+        // find index of proper child to dive into
+        int i = key_rank<true>(node->get_keys(), node->get_keysize(), node->get_capacity(), key);
         delete_node(node->get_child()[i], key); // recursively dive into proper child
+        update_aggregate(node, i);
         key_update(node, key);                  // if my key is deleted at the leaf, update to remove conflict
         
         //                  3
@@ -97,14 +120,57 @@ Node *delete_node(Node *node, int key)
         }
         if (node->get_type() == TREE_ROOT_INTERNAL && node->isEmpty())
         {   // I'm at ROOT_INTERNAL and I"m EMPTY!!
-            // update root pointer to my first child...
+            // pull my first child up into me...
             // since when my key is empty, It means I only have one child
-            node = node->get_child()[0];
+            collapse_root(node);
         }
     }
+
+    if (is_root)
+    {
+        feed_end();
+        write_end(node);
+    }
     return node; // return node pointer to eventually return proper root pointer
 }
 
+/** ************************************************************
+INPUT       : empty root-internal node, left with a single child
+OPERATION   : Move the only child's keys and children into the root,
+and retire the child. The root node itself is kept, so a root
+pointer already handed out to readers never goes stale.
+************************************************************* */
+void collapse_root(Node *node)
+{
+    STAT_COUNT(STAT_ROOT_COLLAPSE);
+    Node *only = node->get_child()[0];
+    int capacity = node->get_capacity();
+
+    for (int i = 0; i < only->get_keysize(); i++)
+    {
+        node->add_key(only->get_key(i));
+    }
+    for (int i = 0; i < capacity + 1; i++)
+    {
+        node->set_child(nullptr, i);
+    }
+
+    if (only->get_type() == TREE_LEAF)
+    {
+        node->set_type(TREE_ROOT_LEAF); // only leaf left, no next to keep
+        node->set_prev(nullptr);
+    }
+    else
+    {
+        for (int i = 0; i < only->get_keysize() + 1; i++)
+        {
+            node->set_child(only->get_child()[i], i);
+        }
+        refresh_aggregates(node);
+    }
+    retire_node(only);
+}
+
 /** ************************************************************
 INPUT       : node pointer where overflow happened
 OPERATION   : decompose overflow node depending on each case.
@@ -121,6 +187,7 @@ void insert_arrange(Node *node)
         *   │ 1 2 3 │ <<   ... # of keys = capacity ... FULL!
         *   └───────┘
         */
+        STAT_COUNT(STAT_ROOT_LEAF_SPLIT);
         Node *child1 = new Node(capacity); // create left child node
         child1->set_type(TREE_LEAF);
         Node *child2 = new Node(capacity); // create right child node
@@ -156,7 +223,7 @@ void insert_arrange(Node *node)
             */
             child2->add_key(node->get_key(j));
         }
-        for (int k = node->get_keysize(); k > 0; --k)
+        for (int k = node->get_keysize() - 1; k > 0; --k)
         {
             /*       ┌───┐
             *        │ 2 │ <<
@@ -179,8 +246,10 @@ void insert_arrange(Node *node)
         node->set_child(child2, 1);
 
         child1->set_next(child2); // set next
+        child2->set_prev(child1);
 
         node->set_type(TREE_ROOT_INTERNAL);
+        refresh_aggregates(node);
         return;
     }
 
@@ -194,6 +263,7 @@ void insert_arrange(Node *node)
         *     │ 1 ││ 2 ││ 3 ││ 4 │
         *     └───┘└───┘└───┘└───┘
         */
+        STAT_COUNT(STAT_ROOT_INTERNAL_SPLIT);
         Node *child3 = new Node(capacity);
         child3->set_type(TREE_INTERNAL);
         Node *child4 = new Node(capacity);
@@ -265,6 +335,7 @@ void insert_arrange(Node *node)
         */
         node->set_child(child3, 0);
         node->set_child(child4, 1);
+        refresh_aggregates(node);
         return;
     }
     // CASE 3   ..  Child node is FULL..
@@ -273,7 +344,7 @@ void insert_arrange(Node *node)
         int parent_size = node->get_keysize();
         int divider = capacity / 2;
         int overflow;
-        Node **child = node->get_child();
+        Children child = node->get_child();
         for (overflow = 0; overflow < parent_size; overflow++)
         {
             if (child[overflow]->isFull())
@@ -293,6 +364,7 @@ void insert_arrange(Node *node)
             *    │ 1 ││ 2 3 4 │
             *    └───┘└───────┘
             */
+            STAT_COUNT(STAT_LEAF_SPLIT);
             Node *child5 = new Node(capacity);
             child5->set_type(TREE_LEAF);
             int index = node->add_key(split_key);
@@ -332,7 +404,12 @@ void insert_arrange(Node *node)
             }
 
             child5->set_next(child[overflow]->get_next()); // set next
+            if (child5->get_next() != NULL)
+            {
+                child5->get_next()->set_prev(child5);
+            }
             child[overflow]->set_next(child5);
+            child5->set_prev(child[overflow]);
         }
 
         // CASE 3-2 ..  child node is INTERNAL node..
@@ -345,6 +422,7 @@ void insert_arrange(Node *node)
             *   │ 1 ││ 3 4 5 │
             *   ├───┤├──┬─┬──┤
             */
+            STAT_COUNT(STAT_INTERNAL_SPLIT);
             Node *child6 = new Node(capacity);
             child6->set_type(TREE_INTERNAL);
             int index = node->add_key(split_key);
@@ -397,6 +475,7 @@ void insert_arrange(Node *node)
                 child[overflow]->set_child(nullptr, k + 1);
             }
         }
+        refresh_aggregates(node);
         return;
     }
     else
@@ -422,7 +501,7 @@ void delete_arrange(Node *node)
             return;
         }
         int underflow;
-        Node **child = node->get_child();
+        Children child = node->get_child();
         for (underflow = 0; underflow < parent_size; underflow++)
         {
             if (child[underflow]->isEmpty())
@@ -435,6 +514,7 @@ void delete_arrange(Node *node)
         // CASE 1   ..  Child node is LEAF node..
         if (child[underflow]->get_type() == TREE_LEAF)
         {
+            STAT_COUNT(tmp == 0 ? STAT_LEAF_MERGE : STAT_LEAF_BORROW);
             if (tmp == 1)
             { // when left adjacent child has more than one key
                 /*    ┌───────┐
@@ -499,7 +579,7 @@ void delete_arrange(Node *node)
             else
             { // when both left and right adjacent child has less than one key
                 if (underflow == 0)
-                { // when leftmost child is not empty
+                { // when leftmost child is empty
                     /*   ┌───────┐
                     *    │ 2  3  │ <<
                     *    ├───┬───┤
@@ -507,12 +587,27 @@ void delete_arrange(Node *node)
                     * │   ││ 2 ││ 3 │
                     * └───┘└───┘└───┘
                     */
-                    for (int i = underflow; i < parent_size; i++)
+                    // keep the left-most leaf, the previous leaf's next points to it
+                    Node *nextchild = child[underflow + 1];
+                    for (int i = 0; i < nextchild->get_keysize(); i++)
                     {
-                        node->get_child()[i]->copy_child(node->get_child()[i + 1]);
+                        child[underflow]->add_key(nextchild->get_key(i));
                     }
-                    node->del_child(parent_size);
+                    child[underflow]->set_next(nextchild->get_next());
+                    if (nextchild->get_next() != NULL)
+                    {
+                        nextchild->get_next()->set_prev(child[underflow]);
+                    }
+                    node->del_child(underflow + 1);
                     node->del_key(node->get_key(0));
+                    retire_node(nextchild);
+                    /*      ┌───┐
+                    *       │ 3 │ <<
+                    *       ├───┤
+                    *    ┌───┐┌───┐
+                    *    │ 2 ││ 3 │
+                    *    └───┘└───┘
+                    */
                 }
                 else
                 {
@@ -523,9 +618,15 @@ void delete_arrange(Node *node)
                     * │ 1 ││   ││ 3 │
                     * └───┘└───┘└───┘
                     */
-                    child[underflow - 1]->set_next(child[underflow]->get_next());
+                    Node *emptychild = child[underflow];
+                    child[underflow - 1]->set_next(emptychild->get_next());
+                    if (emptychild->get_next() != NULL)
+                    {
+                        emptychild->get_next()->set_prev(child[underflow - 1]);
+                    }
                     node->del_child(underflow);
                     node->del_key(node->get_key(underflow - 1));
+                    retire_node(emptychild);
                 }
             }
         }
@@ -533,6 +634,7 @@ void delete_arrange(Node *node)
         // CASE 2   ..  Child node is INTERNAL node..
         else if (child[underflow]->get_type() == TREE_INTERNAL)
         {
+            STAT_COUNT(tmp == 0 ? STAT_INTERNAL_MERGE : STAT_INTERNAL_BORROW);
             if (tmp == 1)
             { // when left adjacent child has more than one key
                 /*      ┌───────┐
@@ -618,9 +720,11 @@ void delete_arrange(Node *node)
                     {
                         nextchild->set_child(nextchild->get_child()[i - 1], i);
                     }
-                    nextchild->set_child(child[underflow]->get_child()[0], 0);
+                    Node *emptychild = child[underflow];
+                    nextchild->set_child(emptychild->get_child()[0], 0);
                     node->del_child(0);
                     node->del_key(number);
+                    retire_node(emptychild);
                     /*      ┌───┐
                     *       │ 6 │ <<
                     *       ├───┤
@@ -639,10 +743,12 @@ void delete_arrange(Node *node)
                     * ├───┤├───┘├───┘
                     */
                     Node *prevchild = child[underflow - 1];
+                    Node *emptychild = child[underflow];
                     prevchild->add_key(node->get_key(underflow - 1));
-                    prevchild->set_child(child[underflow]->get_child()[0], prevchild->get_keysize());
+                    prevchild->set_child(emptychild->get_child()[0], prevchild->get_keysize());
                     node->del_child(underflow);
                     node->del_key(node->get_key(underflow - 1));
+                    retire_node(emptychild);
                     /*      ┌───┐
                     *       │ 6 │ <<
                     *       ├───┤
@@ -654,6 +760,7 @@ void delete_arrange(Node *node)
             }
         }
     }
+    refresh_aggregates(node);
     return;
 }
 
@@ -663,7 +770,7 @@ int check_side(Node *node, int index)
     {
         return 1;
     }
-    else if (node->get_child()[index + 1] != nullptr && node->get_child()[index + 1]->get_keysize() > 1)
+    else if (index < node->get_keysize() && node->get_child()[index + 1]->get_keysize() > 1)
     {
         return 2;
     }
@@ -712,7 +819,7 @@ void key_update(Node *node, int key)
 
 Node *get_leftmost_leaf(Node *node)
 {
-    if (node->get_type() == TREE_LEAF)
+    if (node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF)
     {
         return node;
     }
@@ -722,6 +829,369 @@ Node *get_leftmost_leaf(Node *node)
     }
 }
 
+/** ************************************************************
+INPUT       : Root node pointer, integer key to find
+OPERATION   : Dive into proper child until a leaf is reached,
+then look for the key in that leaf.
+************************************************************* */
+bool find_node(Node *node, int key)
+{
+    STAT_TIMER(STAT_OP_FIND, true);
+    while (node->get_type() != TREE_LEAF && node->get_type() != TREE_ROOT_LEAF)
+    { // find index of proper child to dive into
+        node = node->get_child()[key_rank<true>(node->get_keys(), node->get_keysize(), node->get_capacity(), key)];
+    }
+    int size = node->get_keysize();
+    int i = key_rank<false>(node->get_keys(), size, node->get_capacity(), key);
+    return i < size && node->get_key(i) == key;
+}
+
+/** ************************************************************
+INPUT       : pointer to the root pointer, integer key to find
+OPERATION   : Lock-free lookup that never observes a half-done
+split or merge. The descent runs optimistically inside an
+epoch, so nodes it touches cannot be freed underneath it,
+reads every field through the load_ accessors, and starts
+against the last stable version without waiting for a
+writer. It is retried whenever a writer changed the tree
+meanwhile.
+************************************************************* */
+bool snapshot_find(Node **root, int key)
+{
+    STAT_TIMER(STAT_OP_FIND, true);
+    EpochGuard guard;
+    Node *top = *root;
+    while (true)
+    {
+        unsigned long version = read_begin(top);
+        Node *node = top;
+        bool found = false;
+        bool torn = false;
+
+        for (int depth = 0; !torn; depth++)
+        {
+            TreeNodeType type = node->load_type();
+            bool leaf = type == TREE_LEAF || type == TREE_ROOT_LEAF;
+            int lo = 0;
+            int hi = node->load_keysize();
+            while (lo < hi)
+            { // first key above key, or the first one not below it in a leaf
+                int mid = (lo + hi) / 2;
+                int at = node->load_key(mid);
+                if (leaf ? at < key : at <= key)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            if (leaf)
+            {
+                found = lo < node->load_keysize() && node->load_key(lo) == key;
+                break;
+            }
+            node = node->load_child(lo);
+            torn = node == nullptr || depth > 64; // raced with a writer, start over
+        }
+
+        if (!torn && read_validate(top, version))
+        {
+            return found;
+        }
+    }
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key
+OPERATION   : Dive to the left-most leaf that may hold the key,
+so duplicates of a separator key on its left side are
+not skipped by a scan starting from there.
+************************************************************* */
+Node *find_leaf(Node *node, int key)
+{
+    while (node->get_type() != TREE_LEAF && node->get_type() != TREE_ROOT_LEAF)
+    {
+        node = node->get_child()[key_rank<false>(node->get_keys(), node->get_keysize(), node->get_capacity(), key)];
+    }
+    return node;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, range [lo, hi] of keys
+OPERATION   : Seek the leaf of lo once and follow the leaf chain,
+collecting keys until one is greater than hi.
+************************************************************* */
+vector<int> range_scan(Node *node, int lo, int hi)
+{
+    STAT_TIMER(STAT_OP_SCAN, true);
+    vector<int> keys;
+    for (Node *leaf = find_leaf(node, lo); leaf != NULL; leaf = leaf->get_next())
+    {
+        for (int i = 0; i < leaf->get_keysize(); i++)
+        {
+            int key = leaf->get_key(i);
+            if (key > hi)
+            {
+                return keys;
+            }
+            if (key >= lo)
+            {
+                keys.push_back(key);
+            }
+        }
+    }
+    return keys;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, range [lo, hi] of keys given from
+the top, maximum number of keys to return
+OPERATION   : Seek the leaf of hi once and follow the backward leaf
+chain, collecting keys in descending order until one is
+smaller than lo or limit keys are collected. The newest
+n keys are reverse_scan(node, INT_MAX, INT_MIN, n).
+************************************************************* */
+vector<int> reverse_scan(Node *node, int hi, int lo, unsigned int limit)
+{
+    STAT_TIMER(STAT_OP_SCAN, true);
+    vector<int> keys;
+    Node *leaf = find_leaf(node, hi);
+    while (leaf->get_next() != NULL && !leaf->get_next()->isEmpty() && leaf->get_next()->get_key(0) <= hi)
+    { // a key equal to a separator lives right of it
+        leaf = leaf->get_next();
+    }
+    for (; leaf != NULL; leaf = leaf->get_prev())
+    {
+        for (int i = leaf->get_keysize() - 1; i >= 0; i--)
+        {
+            int key = leaf->get_key(i);
+            if (key < lo || keys.size() >= limit)
+            {
+                return keys;
+            }
+            if (key <= hi)
+            {
+                keys.push_back(key);
+            }
+        }
+    }
+    return keys;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, range [lo, hi] of keys, number of parts
+OPERATION   : Split the range into at most `parts` sub-ranges whose
+boundaries are separator keys of internal nodes.
+Levels are visited from the root down, and the first
+level with enough separators inside the range is used,
+so sub-ranges cover whole subtrees of roughly equal size.
+************************************************************* */
+vector<pair<int, int>> partition_range(Node *node, int lo, int hi, int parts)
+{
+    vector<int> separators;
+    vector<Node *> level(1, node);
+
+    while (parts > 1 && !level.empty() && static_cast<int>(separators.size()) < parts - 1)
+    {
+        if (level[0]->get_type() == TREE_LEAF || level[0]->get_type() == TREE_ROOT_LEAF)
+        {
+            break;
+        }
+        separators.clear();
+        vector<Node *> below;
+        for (Node *curr : level)
+        {
+            int size = curr->get_keysize();
+            for (int i = 0; i <= size; i++)
+            { // only children whose key span overlaps [lo, hi]
+                if ((i > 0 && curr->get_key(i - 1) > hi) || (i < size && curr->get_key(i) <= lo))
+                {
+                    continue;
+                }
+                below.push_back(curr->get_child()[i]);
+                if (i < size && curr->get_key(i) <= hi &&
+                    (separators.empty() || separators.back() != curr->get_key(i)))
+                {
+                    separators.push_back(curr->get_key(i));
+                }
+            }
+        }
+        level.swap(below);
+    }
+
+    vector<pair<int, int>> ranges;
+    int begin = lo;
+    int count = separators.size();
+    int cuts = min(count, parts - 1);
+    for (int c = 1; c <= cuts; c++)
+    {
+        int split = separators[static_cast<long long>(count) * c / (cuts + 1)];
+        if (split > begin)
+        {
+            ranges.push_back(make_pair(begin, split - 1));
+            begin = split;
+        }
+    }
+    ranges.push_back(make_pair(begin, hi));
+    return ranges;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, range [lo, hi] of keys, number of threads
+OPERATION   : Partition the range at separator keys and let every
+thread scan one sub-range along the leaf chain.
+The tree must not be modified while the scan runs.
+************************************************************* */
+vector<vector<int>> parallel_range_scan(Node *node, int lo, int hi, int threads)
+{
+    vector<pair<int, int>> ranges = partition_range(node, lo, hi, threads);
+    vector<vector<int>> results(ranges.size());
+    vector<thread> workers;
+    for (unsigned int i = 0; i < ranges.size(); i++)
+    {
+        workers.push_back(thread([node, &ranges, &results, i]() {
+            results[i] = range_scan(node, ranges[i].first, ranges[i].second);
+        }));
+    }
+    for (unsigned int i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    return results;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer
+OPERATION   : Check every structural invariant of the tree:
+keys strictly ascending inside each node, keys of every
+child at or above the separator on its left and below the
+one on its right, node types, 1 .. capacity - 1 keys in
+every node but a root leaf, which may be empty, no stray
+child pointers, all leaves at the same depth, and a leaf
+chain that visits exactly the leaves in key order and
+ends with NULL.
+The first violation found is printed.
+@return true if the tree is valid.
+************************************************************* */
+bool validate(Node *node)
+{
+    vector<Node *> leaves;
+    if (node->get_type() != TREE_ROOT_LEAF && node->get_type() != TREE_ROOT_INTERNAL)
+    {
+        cout << "validate: root is not typed as root" << endl;
+        return false;
+    }
+    if (validate_node(node, true, INT_MIN, INT_MAX + 1LL, leaves) < 0)
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < leaves.size(); i++)
+    {
+        Node *next = i + 1 < leaves.size() ? leaves[i + 1] : NULL;
+        if (leaves[i]->get_next() != next)
+        {
+            cout << "validate: leaf chain broken after leaf " << i << endl;
+            return false;
+        }
+        Node *prev = i > 0 ? leaves[i - 1] : NULL;
+        if (leaves[i]->get_prev() != prev)
+        {
+            cout << "validate: backward leaf chain broken at leaf " << i << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/** ************************************************************
+INPUT       : node, whether it is the root, bounds [lo, hi) given
+by the parent's separators, list of leaves found so far
+OPERATION   : Recursively validate the subtree, see validate().
+@return height of the subtree, -1 on a violation.
+************************************************************* */
+int validate_node(Node *node, bool root, long long lo, long long hi, vector<Node *> &leaves)
+{
+    int size = node->get_keysize();
+    int capacity = node->get_capacity();
+    bool leaf = node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF;
+
+    if (!root && node->get_type() != TREE_LEAF && node->get_type() != TREE_INTERNAL)
+    {
+        cout << "validate: inner node typed as root" << endl;
+        return -1;
+    }
+    int least = root && leaf ? 0 : 1;
+    if (size < least || size > capacity - 1)
+    {
+        cout << "validate: node holds " << size << " keys, not " << least << " .. " << capacity - 1 << endl;
+        return -1;
+    }
+    for (int i = 0; i < size; i++)
+    {
+        int key = node->get_key(i);
+        if (i > 0 && key <= node->get_key(i - 1))
+        {
+            cout << "validate: keys not strictly ascending at " << key << endl;
+            return -1;
+        }
+        if (key < lo || key >= hi)
+        {
+            cout << "validate: key " << key << " outside of its separators" << endl;
+            return -1;
+        }
+    }
+
+    if (leaf)
+    {
+        for (int i = 0; i < capacity; i++)
+        {
+            if (node->get_child()[i] != NULL)
+            {
+                cout << "validate: leaf has a child" << endl;
+                return -1;
+            }
+        }
+        leaves.push_back(node);
+        return 1;
+    }
+
+    int height = 0;
+    for (int i = 0; i <= capacity; i++)
+    {
+        Node *child = node->get_child()[i];
+        if (i > size)
+        {
+            if (child != NULL)
+            {
+                cout << "validate: stray child pointer behind the last key" << endl;
+                return -1;
+            }
+            continue;
+        }
+        if (child == NULL)
+        {
+            cout << "validate: missing child" << endl;
+            return -1;
+        }
+        long long child_lo = i > 0 ? node->get_key(i - 1) : lo;
+        long long child_hi = i < size ? node->get_key(i) : hi;
+        int child_height = validate_node(child, false, child_lo, child_hi, leaves);
+        if (child_height < 0)
+        {
+            return -1;
+        }
+        if (i > 0 && child_height != height)
+        {
+            cout << "validate: leaves at different depths" << endl;
+            return -1;
+        }
+        height = child_height;
+    }
+    return height + 1;
+}
+
 void print_leaf(Node *node)
 {
     if (node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF)
@@ -1,4 +1,7 @@
 #pragma once
+#include <climits>
+#include <utility>
+#include <vector>
 
 #include "node.h"
 
@@ -8,6 +11,8 @@ void insert_node(Node* node, int key);
 
 Node* delete_node(Node* node, int key);
 
+void collapse_root(Node* node);
+
 void insert_arrange(Node* node);
 
 void delete_arrange(Node* node);
@@ -18,6 +23,24 @@ void key_update(Node* node, int key);
 
 Node* get_leftmost_leaf(Node* node);
 
+bool find_node(Node* node, int key);
+
+bool snapshot_find(Node** root, int key);
+
+Node* find_leaf(Node* node, int key);
+
+vector<int> range_scan(Node* node, int lo, int hi);
+
+vector<int> reverse_scan(Node* node, int hi, int lo, unsigned int limit = UINT_MAX);
+
+vector<pair<int, int>> partition_range(Node* node, int lo, int hi, int parts);
+
+vector<vector<int>> parallel_range_scan(Node* node, int lo, int hi, int threads);
+
+bool validate(Node* node);
+
+int validate_node(Node* node, bool root, long long lo, long long hi, vector<Node*>& leaves);
+
 void print_leaf(Node* node);
 
 void print_tree(Node* node);
@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <climits>
+#include <map>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "split-join.h"
+#include "epoch.h"
+#include "buffered.h"
+
+using namespace std;
+
+namespace
+{
+    typedef BufferedTree::Messages Messages;
+    typedef BufferedTree::Buffers Buffers;
+
+    /** Index of the child of node that holds key
+      */
+    int route(Node *node, int key)
+    {
+        int i = 0;
+        int size = node->get_keysize();
+        while (i < size && key >= node->get_key(i))
+        {
+            i++;
+        }
+        return i;
+    }
+
+    bool contains(Node *leaf, int key)
+    {
+        for (int i = 0; i < leaf->get_keysize(); i++)
+        {
+            if (leaf->get_key(i) == key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Let the newest message for key in buffer decide, if there is one
+      * @return false if buffer holds no message for key.
+      */
+    bool newest_message(const Messages &buffer, int key, bool &present)
+    {
+        for (unsigned int i = buffer.size(); i > 0; i--)
+        {
+            if (buffer[i - 1].first == key)
+            {
+                present = buffer[i - 1].second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool key_less(const pair<int, bool> &a, const pair<int, bool> &b)
+    {
+        return a.first < b.first;
+    }
+
+    /** Move the buffer of node, if any, to the end of out and drop its
+      * entry, so a node retired later leaves nothing behind.
+      */
+    void take_buffer(Buffers &buffers, Node *node, Messages &out)
+    {
+        Buffers::iterator found = buffers.find(node);
+        if (found != buffers.end())
+        {
+            out.insert(out.end(), found->second.begin(), found->second.end());
+            buffers.erase(found);
+        }
+    }
+
+    size_t buffer_size(const Buffers &buffers, Node *node)
+    {
+        Buffers::const_iterator found = buffers.find(node);
+        return found != buffers.end() ? found->second.size() : 0;
+    }
+
+    /** Take the buffers of all children of node, before a split or
+      * merge among them moves key ranges around.
+      */
+    Messages take_child_buffers(Buffers &buffers, Node *node)
+    {
+        Messages stash;
+        for (int i = 0; i <= node->get_keysize(); i++)
+        {
+            Node *child = node->get_child()[i];
+            if (child != nullptr && child->get_type() == TREE_INTERNAL)
+            {
+                take_buffer(buffers, child, stash);
+            }
+        }
+        return stash;
+    }
+
+    /** Hand taken messages to the children now holding their keys.
+      * Different children never share a key, so order is kept per key.
+      */
+    void give_child_buffers(Buffers &buffers, Node *node, const Messages &stash)
+    {
+        for (unsigned int i = 0; i < stash.size(); i++)
+        {
+            buffers[node->get_child()[route(node, stash[i].first)]].push_back(stash[i]);
+        }
+    }
+
+    /** Collect and clear every buffer below node, top-down, keeping
+      * only the newest message of a key.
+      */
+    void take_all_buffers(Buffers &buffers, Node *node, map<int, bool> &newest)
+    {
+        Buffers::iterator found = buffers.find(node);
+        if (found != buffers.end())
+        {
+            Messages &buffer = found->second;
+            for (unsigned int i = buffer.size(); i > 0; i--)
+            { // newest first, an older message never replaces it
+                newest.insert(buffer[i - 1]);
+            }
+            buffers.erase(found);
+        }
+        if (node->get_type() == TREE_INTERNAL || node->get_type() == TREE_ROOT_INTERNAL)
+        {
+            for (int i = 0; i <= node->get_keysize(); i++)
+            {
+                take_all_buffers(buffers, node->get_child()[i], newest);
+            }
+        }
+    }
+} // namespace
+
+namespace Tree
+{
+    /** Create an empty tree whose buffers hold up to limit messages
+      */
+    BufferedTree::BufferedTree(unsigned int capacity, unsigned int limit)
+        : root_(new Node(capacity)), limit_(limit)
+    {
+    }
+
+    BufferedTree::~BufferedTree()
+    {
+        erase_range(root_, INT_MIN, INT_MAX);
+        delete root_;
+    }
+
+    void BufferedTree::insert(int key)
+    {
+        put(key, true);
+    }
+
+    void BufferedTree::erase(int key)
+    {
+        put(key, false);
+    }
+
+    /** ************************************************************
+    INPUT       : integer key
+    OPERATION   : Walk down like find_node, but let the first message
+    for key met on the way decide. Upper buffers hold the
+    newer messages.
+    ************************************************************* */
+    bool BufferedTree::find(int key)
+    {
+        write_begin(root_);
+        Node *node = root_;
+        bool present;
+        for (;;)
+        {
+            Buffers::iterator found = buffers_.find(node);
+            if (found != buffers_.end() && newest_message(found->second, key, present))
+            {
+                break;
+            }
+            if (node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF)
+            {
+                present = contains(node, key);
+                break;
+            }
+            node = node->get_child()[route(node, key)];
+        }
+        write_end(root_);
+        return present;
+    }
+
+    /** Scan the range [lo, hi] after flushing every buffer
+      */
+    vector<int> BufferedTree::range_scan(int lo, int hi)
+    {
+        write_begin(root_);
+        flush_all();
+        vector<int> keys = ::range_scan(root_, lo, hi);
+        write_end(root_);
+        return keys;
+    }
+
+    /** Empty every buffer, see flush_all()
+      */
+    void BufferedTree::flush()
+    {
+        write_begin(root_);
+        flush_all();
+        write_end(root_);
+    }
+
+    /** ************************************************************
+    OPERATION   : With the writer lock held, gather the newest message
+    of each key at the root and push them all the way down,
+    without a limit. A split or merge may leave messages in a
+    child's buffer, so repeat until no buffer is left.
+    Afterwards the tree is an ordinary B+ tree.
+    ************************************************************* */
+    void BufferedTree::flush_all()
+    {
+        while (!buffers_.empty())
+        {
+            map<int, bool> newest;
+            take_all_buffers(buffers_, root_, newest);
+            buffers_[root_].assign(newest.begin(), newest.end());
+            drain_root(0);
+        }
+    }
+
+    /** Number of messages not yet applied to a leaf
+      */
+    long BufferedTree::pending()
+    {
+        write_begin(root_);
+        long count = 0;
+        for (Buffers::iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+        {
+            count += it->second.size();
+        }
+        write_end(root_);
+        return count;
+    }
+
+    /** Root of the tree, every message applied. Reading it directly
+      * is only safe while no other thread calls into the tree.
+      */
+    Node *BufferedTree::root()
+    {
+        flush();
+        return root_;
+    }
+
+    /** Add the bytes of the message buffers, with their index, to usage.
+      * The nodes themselves are counted by memory_usage(root()).
+      */
+    void BufferedTree::add_memory(MemoryUsage &usage)
+    {
+        write_begin(root_);
+        usage.buffer_bytes += buffers_.bucket_count() * sizeof(void *);
+        for (Buffers::iterator it = buffers_.begin(); it != buffers_.end(); ++it)
+        {
+            usage.buffer_bytes += sizeof(Buffers::value_type) + sizeof(void *); // hash node
+            usage.buffer_bytes += it->second.capacity() * sizeof(Messages::value_type);
+        }
+        write_end(root_);
+    }
+
+    /** Queue the message at the root and drain it to the limit
+      */
+    void BufferedTree::put(int key, bool insert)
+    {
+        write_begin(root_);
+        buffers_[root_].push_back(make_pair(key, insert));
+        drain_root(limit_);
+        write_end(root_);
+    }
+
+    /** ************************************************************
+    INPUT       : messages a buffer may keep, with the writer lock held
+    OPERATION   : Flush the root while its buffer is over limit,
+    splitting or collapsing the root in between as
+    insert_node and delete_node would. A root leaf takes
+    messages directly.
+    ************************************************************* */
+    void BufferedTree::drain_root(unsigned int limit)
+    {
+        for (;;)
+        { // flush_node() moves the root's entry, so look it up every round
+            Messages &buffer = buffers_[root_];
+            if (buffer.empty())
+            {
+                buffers_.erase(root_);
+                break;
+            }
+            if (root_->get_type() != TREE_ROOT_LEAF && buffer.size() <= limit)
+            {
+                break;
+            }
+            if (root_->get_type() == TREE_ROOT_LEAF)
+            { // nothing to buffer in yet, apply the oldest message
+                pair<int, bool> message = buffer.front();
+                buffer.erase(buffer.begin());
+                bool present = contains(root_, message.first);
+                if (message.second && !present)
+                {
+                    root_->add_key(message.first);
+                    if (root_->isFull())
+                    {
+                        insert_arrange(root_); // [[CASE 1]]
+                    }
+                }
+                else if (!message.second && present)
+                {
+                    root_->del_key(message.first);
+                }
+                continue;
+            }
+
+            flush_node(root_, limit);
+            if (root_->isFull())
+            {
+                insert_arrange(root_); // [[CASE 2]], the buffer stays with the root
+            }
+            else if (root_->isEmpty())
+            {
+                Node *only = root_->get_child()[0];
+                if (only->get_type() == TREE_INTERNAL)
+                { // the child's messages are the older ones
+                    Messages older;
+                    take_buffer(buffers_, only, older);
+                    Messages &rest = buffers_[root_];
+                    rest.insert(rest.begin(), older.begin(), older.end());
+                }
+                collapse_root(root_);
+            }
+        }
+    }
+
+    /** ************************************************************
+    INPUT       : internal node with a non-empty buffer, messages a
+    buffer may keep
+    OPERATION   : Move the whole buffer one level down in key order,
+    so every child is visited once. An internal child takes
+    its run of messages into its own buffer, flushing it in
+    turn if that holds more than limit; leaves get messages
+    applied one by one. Splits and merges of the children are done
+    with insert_arrange / delete_arrange, with the
+    children's buffers re-routed around them. Stops early,
+    keeping the rest, once node itself is full or empty,
+    which its parent has to fix first.
+    ************************************************************* */
+    void BufferedTree::flush_node(Node *node, unsigned int limit)
+    {
+        Messages batch;
+        take_buffer(buffers_, node, batch);
+        // stable, so the messages of a key stay in arrival order
+        stable_sort(batch.begin(), batch.end(), key_less);
+
+        unsigned int j = 0;
+        while (j < batch.size())
+        {
+            if (node->isFull() || node->isEmpty())
+            { // the parent splits or merges me first
+                Messages &buffer = buffers_[node];
+                buffer.insert(buffer.end(), batch.begin() + j, batch.end());
+                return;
+            }
+            int i = route(node, batch[j].first);
+            Node *child = node->get_child()[i];
+
+            if (child->get_type() == TREE_INTERNAL)
+            {
+                unsigned int end = j;
+                while (end < batch.size() && (i == node->get_keysize() || batch[end].first < node->get_key(i)))
+                {
+                    end++;
+                }
+                Messages &below = buffers_[child];
+                below.insert(below.end(), batch.begin() + j, batch.begin() + end);
+                j = end;
+                while (buffer_size(buffers_, child) > limit && !child->isFull() && !child->isEmpty())
+                {
+                    flush_node(child, limit);
+                }
+                if (child->isFull() || child->isEmpty())
+                {
+                    Messages stash = take_child_buffers(buffers_, node);
+                    if (child->isFull())
+                    {
+                        insert_arrange(node); // [[CASE 3-2]]
+                    }
+                    else
+                    {
+                        delete_arrange(node);
+                    }
+                    give_child_buffers(buffers_, node, stash);
+                }
+                continue;
+            }
+
+            int key = batch[j].first;
+            bool present = contains(child, key);
+            if (batch[j].second && !present)
+            {
+                child->add_key(key);
+                if (child->isFull())
+                {
+                    insert_arrange(node); // [[CASE 3-1]]
+                }
+            }
+            else if (!batch[j].second && present)
+            {
+                child->del_key(key);
+                if (child->isEmpty())
+                {
+                    delete_arrange(node);
+                }
+            }
+            j++;
+        }
+    }
+} // namespace Tree
@@ -0,0 +1,56 @@
+#pragma once
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Write-optimized tree with message buffers in internal nodes
+      * (B-epsilon tree style).
+      *
+      * Inserts and deletes are queued as messages in the root's buffer.
+      * A buffer that grows past the limit is flushed: its messages move
+      * down one level in key order, into the children's buffers or, one
+      * level above the leaves, into the leaves themselves. A node is thus
+      * touched once per batch instead of once per key. Lookups check the
+      * buffers on their path, newest first. Range scans, and anything
+      * else that reads the plain tree, flush every buffer first.
+      * The buffers are kept by the tree, keyed by node, so plain nodes
+      * carry nothing for them; a node without messages has no entry.
+      * Every public call runs under the writer lock of the tree, lookups
+      * included, as they walk the buffers writers change; the tree may
+      * be shared between threads, but its calls do not run in parallel.
+      */
+    class BufferedTree
+    {
+    public:
+        typedef std::vector<std::pair<int, bool>> Messages; // (key, insert), oldest first
+        typedef std::unordered_map<Node *, Messages> Buffers;
+
+        BufferedTree(unsigned int capacity, unsigned int limit);
+        ~BufferedTree();
+        BufferedTree(const BufferedTree &) = delete;
+        BufferedTree &operator=(const BufferedTree &) = delete;
+
+        void insert(int key);
+        void erase(int key);
+        bool find(int key);
+        std::vector<int> range_scan(int lo, int hi);
+        void flush();
+        long pending();
+        Node *root();
+        void add_memory(MemoryUsage &usage);
+
+    private:
+        void put(int key, bool insert);
+        void flush_all();
+        void drain_root(unsigned int limit);
+        void flush_node(Node *node, unsigned int limit);
+
+        Node *root_;
+        unsigned int limit_;
+        Buffers buffers_;
+    };
+} // namespace Tree
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "node.h"
+#include "bulk.h"
+
+using namespace std;
+
+using Tree::Node;
+
+/** ************************************************************
+INPUT       : unsorted keys, capacity of the tree, number of threads
+OPERATION   : Sort keys in parallel, then bulk build on top of them.
+************************************************************* */
+Node *parallel_bulk_build(vector<int> keys, unsigned int capacity, unsigned int threads)
+{
+    parallel_sort(keys, threads);
+    return bulk_build(keys, capacity, threads);
+}
+
+/** ************************************************************
+INPUT       : sorted keys, capacity of the tree, number of threads
+OPERATION   : Build a tree bottom-up without any split.
+Every thread builds its own run of leaves, the runs are
+stitched together with set_next, and the internal levels
+are built on top of them.
+Leaves are filled up to capacity - 1 keys, which is the most
+a leaf holds without being split by insert_node.
+************************************************************* */
+Node *bulk_build(const vector<int> &keys, unsigned int capacity, unsigned int threads)
+{
+    int size = keys.size();
+    if (size == 0)
+    {
+        return new Node(capacity);
+    }
+
+    int per_leaf = capacity - 1;
+    int count = (size + per_leaf - 1) / per_leaf;
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+    if (static_cast<int>(threads) > count)
+    {
+        threads = count;
+    }
+
+    /*  leaf j always owns keys [j * size / count, (j + 1) * size / count),
+    *   so every thread builds exactly the leaves a sequential build would.
+    */
+    vector<Node *> leaves(count);
+    vector<thread> workers;
+    for (unsigned int t = 0; t < threads; t++)
+    {
+        int first = static_cast<long long>(count) * t / threads;
+        int last = static_cast<long long>(count) * (t + 1) / threads;
+        workers.push_back(thread(build_leaves, cref(keys), first, last, count, capacity, ref(leaves)));
+    }
+    for (unsigned int t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+
+    vector<int> lows(count);
+    for (int j = 0; j < count; j++)
+    {
+        lows[j] = leaves[j]->get_key(0);
+        if (j + 1 < count)
+        {
+            leaves[j]->set_next(leaves[j + 1]); // stitch runs of different threads
+            leaves[j + 1]->set_prev(leaves[j]);
+        }
+    }
+    return build_levels(leaves, lows, capacity);
+}
+
+/** ************************************************************
+INPUT       : keys, number of threads
+OPERATION   : Sort equal chunks concurrently, then merge neighbouring
+chunks pairwise, doubling the chunk width every round.
+************************************************************* */
+void parallel_sort(vector<int> &keys, unsigned int threads)
+{
+    int size = keys.size();
+    if (threads <= 1 || size < 2)
+    {
+        sort(keys.begin(), keys.end());
+        return;
+    }
+
+    vector<int> bound(threads + 1);
+    for (unsigned int t = 0; t <= threads; t++)
+    {
+        bound[t] = static_cast<long long>(size) * t / threads;
+    }
+
+    vector<thread> workers;
+    for (unsigned int t = 0; t < threads; t++)
+    {
+        workers.push_back(thread([&keys, &bound, t]() {
+            sort(keys.begin() + bound[t], keys.begin() + bound[t + 1]);
+        }));
+    }
+    for (unsigned int t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+
+    for (unsigned int width = 1; width < threads; width *= 2)
+    {
+        workers.clear();
+        for (unsigned int t = 0; t + width < threads; t += 2 * width)
+        {
+            int first = bound[t];
+            int middle = bound[t + width];
+            int last = bound[min(t + 2 * width, threads)];
+            workers.push_back(thread([&keys, first, middle, last]() {
+                inplace_merge(keys.begin() + first, keys.begin() + middle, keys.begin() + last);
+            }));
+        }
+        for (unsigned int t = 0; t < workers.size(); t++)
+        {
+            workers[t].join();
+        }
+    }
+}
+
+/** ************************************************************
+INPUT       : sorted keys, range [first, last) of leaf indexes out of
+count leaves, capacity, output leaf list
+OPERATION   : Create leaves first .. last - 1 and chain them.
+The last leaf of the run is linked by the caller.
+************************************************************* */
+void build_leaves(const vector<int> &keys, int first, int last, int count, unsigned int capacity, vector<Node *> &leaves)
+{
+    long long size = keys.size();
+    for (int j = first; j < last; j++)
+    {
+        Node *leaf = new Node(capacity);
+        leaf->set_type(TREE_LEAF);
+        for (long long k = size * j / count; k < size * (j + 1) / count; k++)
+        {
+            leaf->add_key(keys[k]);
+        }
+        leaves[j] = leaf;
+        if (j > first)
+        {
+            leaves[j - 1]->set_next(leaf);
+            leaf->set_prev(leaves[j - 1]);
+        }
+    }
+}
+
+/** ************************************************************
+INPUT       : nodes of one level from left to right, smallest key
+under each of them, capacity
+OPERATION   : Group up to capacity nodes under a new parent,
+level by level, until a single root is left.
+Groups are sized evenly, so every parent has at least two
+children and at least one key.
+************************************************************* */
+Node *build_levels(vector<Node *> &nodes, vector<int> &lows, unsigned int capacity)
+{
+    if (nodes.size() == 1)
+    {
+        nodes[0]->set_type(TREE_ROOT_LEAF);
+        return nodes[0];
+    }
+
+    while (nodes.size() > 1)
+    {
+        long long size = nodes.size();
+        int count = (size + capacity - 1) / capacity;
+        vector<Node *> parents(count);
+        vector<int> parent_lows(count);
+
+        for (int j = 0; j < count; j++)
+        {
+            int first = size * j / count;
+            int last = size * (j + 1) / count;
+            Node *parent = new Node(capacity);
+            parent->set_type(TREE_INTERNAL);
+            for (int k = first; k < last; k++)
+            {
+                if (k > first)
+                {
+                    parent->add_key(lows[k]);
+                }
+                parent->set_child(nodes[k], k - first);
+            }
+            parents[j] = parent;
+            parent_lows[j] = lows[first];
+        }
+        nodes.swap(parents);
+        lows.swap(parent_lows);
+    }
+
+    nodes[0]->set_type(TREE_ROOT_INTERNAL);
+    return nodes[0];
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <vector>
+
+#include "node.h"
+
+using namespace Tree;
+
+Node* bulk_build(const vector<int>& keys, unsigned int capacity, unsigned int threads);
+
+Node* parallel_bulk_build(vector<int> keys, unsigned int capacity, unsigned int threads);
+
+void parallel_sort(vector<int>& keys, unsigned int threads);
+
+void build_leaves(const vector<int>& keys, int first, int last, int count, unsigned int capacity, vector<Node*>& leaves);
+
+Node* build_levels(vector<Node*>& nodes, vector<int>& lows, unsigned int capacity);
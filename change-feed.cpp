@@ -0,0 +1,445 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "epoch.h"
+#include "fixed-capacity.h"
+#include "upsert.h"
+#include "change-feed.h"
+
+using namespace std;
+
+namespace
+{
+    const size_t RECORD_BYTES = sizeof(unsigned long long) + sizeof(int) + 1;
+
+    mutex registry_mutex;
+    vector<pair<Node *, ChangeFeed *>> registry; // root, its feed
+    atomic<size_t> attached(0);
+    thread_local ChangeFeed *current = nullptr; // feed of the mutation in progress
+
+    void detach(Node *root, ChangeFeed *feed)
+    {
+        lock_guard<mutex> lock(registry_mutex);
+        for (unsigned int i = 0; i < registry.size(); i++)
+        {
+            if (registry[i].first == root || registry[i].second == feed)
+            {
+                registry.erase(registry.begin() + i--);
+            }
+        }
+        attached.store(registry.size());
+    }
+
+    /** @return root of the tree feed is attached to, nullptr if none.
+      */
+    Node *root_of(ChangeFeed *feed)
+    {
+        lock_guard<mutex> lock(registry_mutex);
+        for (unsigned int i = 0; i < registry.size(); i++)
+        {
+            if (registry[i].second == feed)
+            {
+                return registry[i].first;
+            }
+        }
+        return nullptr;
+    }
+
+    /** Leaf that holds key, and the separator that bounds it above,
+      * LLONG_MAX for the last leaf.
+      */
+    Node *leaf_of(Node *node, int key, long long &hi)
+    {
+        hi = LLONG_MAX;
+        while (node->get_type() != TREE_LEAF && node->get_type() != TREE_ROOT_LEAF)
+        {
+            int i = key_rank<true>(node->get_keys(), node->get_keysize(), node->get_capacity(), key);
+            if (i < node->get_keysize())
+            {
+                hi = node->get_key(i);
+            }
+            node = node->get_child()[i];
+        }
+        return node;
+    }
+
+    /** ************************************************************
+    INPUT       : leaf, record whose key the leaf covers
+    OPERATION   : Apply the record to the leaf directly if that keeps
+    it within 1 .. capacity - 1 keys and leaves its first key,
+    which a separator may repeat, alone.
+    @return false if the record needs the single-key path.
+    ************************************************************* */
+    bool apply_in_leaf(Node *leaf, const FeedRecord &record)
+    {
+        int size = leaf->get_keysize();
+        int i = key_rank<false>(leaf->get_keys(), size, leaf->get_capacity(), record.key);
+        bool present = i < size && leaf->get_key(i) == record.key;
+        if (record.op == FEED_INSERT)
+        {
+            if (present)
+            {
+                return true;
+            }
+            if (size >= leaf->get_capacity() - 1)
+            {
+                return false;
+            }
+            leaf->add_key(record.key);
+            feed_record(FEED_INSERT, record.key);
+            return true;
+        }
+        if (!present)
+        {
+            return true;
+        }
+        if (i == 0 && leaf->get_type() != TREE_ROOT_LEAF)
+        {
+            return false;
+        }
+        leaf->del_key(record.key);
+        feed_record(FEED_ERASE, record.key);
+        return true;
+    }
+
+    void apply_single(Node *root, const FeedRecord &record)
+    {
+        if (record.op == FEED_INSERT)
+        {
+            try_insert(root, record.key);
+        }
+        else
+        {
+            erase_if(root, record.key, nullptr, nullptr);
+        }
+    }
+} // namespace
+
+namespace Tree
+{
+    /** Feed sending batches of records to writer, called with context
+      */
+    ChangeFeed::ChangeFeed(FeedWriter writer, void *context, unsigned int batch)
+        : writer_(writer), context_(context), batch_(batch == 0 ? 1 : batch), sequence_(0), failed_(false)
+    {
+        buffer_.reserve(batch_);
+    }
+
+    /** Detach from its tree and send what is left.
+      * No mutation of the tree may be running.
+      */
+    ChangeFeed::~ChangeFeed()
+    {
+        detach(nullptr, this);
+        drain();
+    }
+
+    /** Number the change and buffer it, sending the batch once full.
+      * Called by the mutation itself, with the writer lock held.
+      */
+    void ChangeFeed::record(char op, int key)
+    {
+        FeedRecord change = {++sequence_, key, op};
+        buffer_.push_back(change);
+        if (buffer_.size() >= batch_)
+        {
+            drain();
+        }
+    }
+
+    /** Send the buffered records now, e.g. when writes pause, so the
+      * replicas catch up. Takes the writer lock of its tree.
+      * @return false once the transport failed.
+      */
+    bool ChangeFeed::flush()
+    {
+        Node *root = root_of(this);
+        if (root == nullptr)
+        { // detached, no mutation records into it any more
+            return drain();
+        }
+        write_begin(root);
+        bool sent = drain();
+        write_end(root);
+        return sent;
+    }
+
+    /** flush() for callers that hold the writer lock already.
+      * Records a failed transport could not take are dropped, which a
+      * replica sees as a gap in the sequence.
+      */
+    bool ChangeFeed::drain()
+    {
+        if (!buffer_.empty() && !failed_)
+        {
+            failed_ = !writer_(buffer_.data(), buffer_.size(), context_);
+        }
+        buffer_.clear();
+        return !failed_;
+    }
+
+    /** @return sequence number of the last change recorded.
+      */
+    unsigned long long ChangeFeed::sequence()
+    {
+        return sequence_;
+    }
+
+    bool ChangeFeed::failed()
+    {
+        return failed_;
+    }
+
+    /** ************************************************************
+    INPUT       : records to send, FeedPipe
+    OPERATION   : Encode the records and write them whole, retrying on
+    short writes and interrupts.
+    @return false if the descriptor failed.
+    ************************************************************* */
+    bool feed_pipe_write(const FeedRecord *records, size_t count, void *pipe)
+    {
+        int fd = static_cast<FeedPipe *>(pipe)->fd;
+        vector<char> bytes(count * RECORD_BYTES);
+        for (size_t r = 0; r < count; r++)
+        {
+            char *out = bytes.data() + r * RECORD_BYTES;
+            memcpy(out, &records[r].sequence, sizeof(unsigned long long));
+            memcpy(out + sizeof(unsigned long long), &records[r].key, sizeof(int));
+            out[RECORD_BYTES - 1] = records[r].op;
+        }
+        size_t done = 0;
+        while (done < bytes.size())
+        {
+            ssize_t written = write(fd, bytes.data() + done, bytes.size() - done);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            done += written;
+        }
+        return true;
+    }
+
+    /** ************************************************************
+    INPUT       : output records, their number, FeedPipe
+    OPERATION   : Wait until at least one whole record has arrived and
+    decode all whole records read so far, up to limit. Bytes
+    of a record cut off by the read are kept for the next call.
+    @return number of records, 0 at end of file or on an error.
+    ************************************************************* */
+    size_t feed_pipe_read(FeedRecord *records, size_t limit, void *pipe)
+    {
+        FeedPipe *feed = static_cast<FeedPipe *>(pipe);
+        vector<char> &bytes = feed->partial;
+        while (bytes.size() < RECORD_BYTES)
+        {
+            size_t have = bytes.size();
+            bytes.resize(max(limit, size_t(1)) * RECORD_BYTES);
+            ssize_t got = read(feed->fd, bytes.data() + have, bytes.size() - have);
+            bytes.resize(have + max<ssize_t>(got, 0));
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got <= 0)
+            {
+                return 0;
+            }
+        }
+
+        size_t count = min(limit, bytes.size() / RECORD_BYTES);
+        for (size_t r = 0; r < count; r++)
+        {
+            const char *in = bytes.data() + r * RECORD_BYTES;
+            memcpy(&records[r].sequence, in, sizeof(unsigned long long));
+            memcpy(&records[r].key, in + sizeof(unsigned long long), sizeof(int));
+            records[r].op = in[RECORD_BYTES - 1];
+        }
+        bytes.erase(bytes.begin(), bytes.begin() + count * RECORD_BYTES);
+        return count;
+    }
+
+    /** Applier of a feed to root, which already reflects every record
+      * up to sequence applied.
+      */
+    ReplicaApplier::ReplicaApplier(Node *root, bool leaf_deltas, unsigned long long applied)
+        : root_(root), leaf_deltas_(leaf_deltas), applied_(applied) {}
+
+    /** ************************************************************
+    INPUT       : records in sequence order, their number
+    OPERATION   : Skip records already applied and apply the ones that
+    follow without a gap, one by one or as leaf deltas.
+    @return false if a gap stopped the applier.
+    ************************************************************* */
+    bool ReplicaApplier::apply(const FeedRecord *records, size_t count)
+    {
+        size_t first = 0;
+        while (first < count && records[first].sequence <= applied_)
+        {
+            first++;
+        }
+        size_t last = first;
+        while (last < count && records[last].sequence == applied_ + (last - first) + 1)
+        {
+            last++;
+        }
+
+        if (leaf_deltas_)
+        {
+            deltas_.assign(records + first, records + last);
+            apply_deltas(deltas_);
+        }
+        else
+        {
+            for (size_t r = first; r < last; r++)
+            {
+                apply_single(root_, records[r]);
+            }
+        }
+        applied_ += last - first;
+        return last == count;
+    }
+
+    /** ************************************************************
+    INPUT       : transport reader, its context, records per batch
+    OPERATION   : Read and apply batches until the feed ends.
+    @return false if it stopped at a gap instead.
+    ************************************************************* */
+    bool ReplicaApplier::consume(FeedReader reader, void *context, size_t batch)
+    {
+        vector<FeedRecord> records(max(batch, size_t(1)));
+        size_t count;
+        while ((count = reader(records.data(), records.size(), context)) > 0)
+        {
+            if (!apply(records.data(), count))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** @return sequence number of the last record applied.
+      */
+    unsigned long long ReplicaApplier::applied()
+    {
+        return applied_;
+    }
+
+    /** ************************************************************
+    INPUT       : gap-free records of one batch
+    OPERATION   : Keep the last operation on every key, which decides
+    whether it ends up in the tree, sort by key and apply the
+    run of keys below each leaf's upper separator under one
+    descent and one writer section. Augmented trees take the
+    single-key path, which keeps their aggregates.
+    ************************************************************* */
+    void ReplicaApplier::apply_deltas(vector<FeedRecord> &records)
+    {
+        stable_sort(records.begin(), records.end(), [](const FeedRecord &a, const FeedRecord &b) {
+            return a.key < b.key;
+        });
+        size_t size = 0;
+        for (size_t r = 0; r < records.size(); r++)
+        {
+            if (size > 0 && records[size - 1].key == records[r].key)
+            {
+                records[size - 1] = records[r];
+            }
+            else
+            {
+                records[size++] = records[r];
+            }
+        }
+        records.resize(size);
+
+        bool augmented = root_->get_monoid() != nullptr;
+        size_t r = 0;
+        while (r < size)
+        {
+            if (augmented)
+            {
+                apply_single(root_, records[r++]);
+                continue;
+            }
+            write_begin(root_);
+            feed_begin(root_);
+            long long hi;
+            Node *leaf = leaf_of(root_, records[r].key, hi);
+            while (r < size && records[r].key < hi && apply_in_leaf(leaf, records[r]))
+            {
+                r++;
+            }
+            feed_end();
+            write_end(root_);
+            if (r < size && records[r].key < hi)
+            { // would split or merge the leaf
+                apply_single(root_, records[r++]);
+            }
+        }
+    }
+} // namespace Tree
+
+/** ************************************************************
+INPUT       : root of a tree, its feed, nullptr to detach
+OPERATION   : Record the changes of the tree in feed from now on.
+A tree has at most one feed, and a feed one tree.
+************************************************************* */
+void attach_feed(Node *root, ChangeFeed *feed)
+{
+    detach(root, feed);
+    if (feed != nullptr)
+    {
+        lock_guard<mutex> lock(registry_mutex);
+        registry.push_back(make_pair(root, feed));
+        attached.store(registry.size());
+    }
+}
+
+/** Look up the feed of root for the mutation starting on it, with
+  * the writer lock held. Free while no feed is attached at all.
+  */
+void feed_begin(Node *root)
+{
+    current = nullptr;
+    if (attached.load(memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    lock_guard<mutex> lock(registry_mutex);
+    for (unsigned int i = 0; i < registry.size(); i++)
+    {
+        if (registry[i].first == root)
+        {
+            current = registry[i].second;
+        }
+    }
+}
+
+/** Record a change of the mutation in progress, if its tree has a feed
+  */
+void feed_record(char op, int key)
+{
+    if (current != nullptr)
+    {
+        current->record(op, key);
+    }
+}
+
+void feed_end()
+{
+    current = nullptr;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** One mutation of a tree, numbered in the order it was applied.
+      * op is FEED_INSERT or FEED_ERASE, the same letters as in traces.
+      */
+    struct FeedRecord
+    {
+        unsigned long long sequence;
+        int key;
+        char op;
+    };
+
+    const char FEED_INSERT = 'i';
+    const char FEED_ERASE = 'd';
+
+    /** Transport of a feed: the writer sends count records and returns
+      * false if they could not be sent, the reader blocks for at least
+      * one record, fills up to limit and returns 0 at the end of the feed.
+      */
+    typedef bool (*FeedWriter)(const FeedRecord *records, size_t count, void *context);
+    typedef size_t (*FeedReader)(FeedRecord *records, size_t limit, void *context);
+
+    /** Change-data capture of one tree.
+      *
+      * Once attached to a root with attach_feed(), every key that
+      * insert_node(), delete_node() or update() actually adds to or
+      * removes from a leaf is recorded with the next sequence number.
+      * Records are taken while the writer lock is held, so the sequence
+      * is the order in which the tree changed. They are buffered and
+      * handed to the writer batch at a time, from the mutation that
+      * fills the batch, so a slow transport holds back writers instead
+      * of dropping records. Whole-tree operations (bulk builds,
+      * erase_range, split and join) are not recorded; a replica starts
+      * from a copy taken at sequence() and follows the feed from there.
+      */
+    class ChangeFeed
+    {
+    public:
+        ChangeFeed(FeedWriter writer, void *context, unsigned int batch = 1024);
+        ~ChangeFeed();
+        ChangeFeed(const ChangeFeed &) = delete;
+        ChangeFeed &operator=(const ChangeFeed &) = delete;
+
+        void record(char op, int key);
+        bool flush();
+        bool drain();
+        unsigned long long sequence();
+        bool failed();
+
+    private:
+        FeedWriter writer_;
+        void *context_;
+        unsigned int batch_;
+        unsigned long long sequence_;
+        std::vector<FeedRecord> buffer_;
+        bool failed_;
+    };
+
+    /** A feed over a file descriptor: a pipe, a FIFO or a file.
+      * Records travel as 13 little-endian bytes: sequence, key, op.
+      */
+    struct FeedPipe
+    {
+        int fd;
+        std::vector<char> partial; // bytes of a record not read whole yet
+
+        FeedPipe(int descriptor) : fd(descriptor) {}
+    };
+
+    bool feed_pipe_write(const FeedRecord *records, size_t count, void *pipe);
+    size_t feed_pipe_read(FeedRecord *records, size_t limit, void *pipe);
+
+    /** Applies a feed to a replica tree.
+      *
+      * Records at or below the applied sequence are skipped, so a feed
+      * can be replayed from any earlier point; a record past the next
+      * sequence is a gap and stops the applier. One record at a time
+      * goes through try_insert() or erase_if(), a single descent each.
+      * With leaf deltas, a batch is reduced to the last operation on
+      * every key, sorted, and cut into runs that fall into one leaf:
+      * each run is applied to its leaf in place after one descent, and
+      * only a change that would split or merge the leaf takes the
+      * single-key path.
+      */
+    class ReplicaApplier
+    {
+    public:
+        ReplicaApplier(Node *root, bool leaf_deltas, unsigned long long applied = 0);
+
+        bool apply(const FeedRecord *records, size_t count);
+        bool consume(FeedReader reader, void *context, size_t batch);
+        unsigned long long applied();
+
+    private:
+        void apply_deltas(std::vector<FeedRecord> &records);
+
+        Node *root_;
+        bool leaf_deltas_;
+        unsigned long long applied_;
+        std::vector<FeedRecord> deltas_;
+    };
+} // namespace Tree
+
+using namespace Tree;
+
+void attach_feed(Node* root, ChangeFeed* feed);
+
+void feed_begin(Node* root);
+
+void feed_record(char op, int key);
+
+void feed_end();
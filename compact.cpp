@@ -0,0 +1,200 @@
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "aggregate.h"
+#include "epoch.h"
+#include "stats.h"
+#include "compact.h"
+
+using namespace std;
+
+namespace
+{
+    bool is_leaf(Node *node)
+    {
+        return node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF;
+    }
+
+    /** Keys per leaf to repack to: three quarters of what a leaf
+      * holds, so inserts right after a pass do not split at once.
+      */
+    int compact_fill(int capacity)
+    {
+        int fill = (3 * (capacity - 1) + 3) / 4;
+        return fill > 0 ? fill : 1;
+    }
+
+    void clear_keys(Node *node)
+    {
+        while (!node->isEmpty())
+        {
+            node->del_key(node->get_key(node->get_keysize() - 1));
+        }
+    }
+} // namespace
+
+/** ************************************************************
+INPUT       : Root node pointer, cursor, number of leaves to visit
+OPERATION   : Starting at the leaf parent of cursor.key, repack the
+leaves below one parent after the other until budget
+leaves were looked at, and move the cursor behind the last
+one. Each parent is done in a write of its own, so
+readers and writers get in between, and one call costs
+O(budget * capacity) plus at most one parent more.
+************************************************************* */
+void compact_step(Node *node, CompactCursor &cursor, unsigned int budget)
+{
+    unsigned int visited = 0;
+    while (!cursor.done && visited < budget)
+    {
+        write_begin(node);
+        Node *parent = find_leaf_parent(node, cursor.key);
+        if (parent == nullptr)
+        { // a single leaf, nothing to merge
+            cursor.done = true;
+            write_end(node);
+            break;
+        }
+        int leaves = parent->get_keysize() + 1;
+        Node *after = parent->get_child()[leaves - 1]->get_next();
+        cursor.freed += compact_parent(parent, parent == node);
+        if (after == nullptr || is_leaf(node))
+        {
+            cursor.done = true;
+        }
+        else
+        { // the next parent's first leaf
+            cursor.key = after->get_key(0);
+        }
+        write_end(node);
+        visited += leaves;
+    }
+}
+
+/** ************************************************************
+INPUT       : Root node pointer
+OPERATION   : Run a whole compaction pass at once.
+@return number of leaves freed.
+************************************************************* */
+unsigned long compact_leaves(Node *node)
+{
+    CompactCursor cursor;
+    compact_step(node, cursor, UINT_MAX);
+    return cursor.freed;
+}
+
+/** ************************************************************
+INPUT       : internal node whose children are leaves, whether it is
+the root
+OPERATION   : Spread the keys of all its leaves evenly over as few
+leaves as hold them at compact_fill(), keeping the
+left-most ones and the leaf chain, retire the rest and
+rebuild the separators from the new first keys. A root
+left with one leaf collapses into it. Must run inside a
+write, see compact_step().
+@return number of leaves freed, 0 if they were dense enough.
+************************************************************* */
+int compact_parent(Node *node, bool root)
+{
+    // reused across calls, so a step does not go to the heap
+    static thread_local vector<Node *> leaves;
+    static thread_local vector<int> keys;
+    leaves.clear();
+    keys.clear();
+
+    int capacity = node->get_capacity();
+    int count = node->get_keysize() + 1;
+    for (int i = 0; i < count; i++)
+    {
+        leaves.push_back(node->get_child()[i]);
+        for (int j = 0; j < leaves[i]->get_keysize(); j++)
+        {
+            keys.push_back(leaves[i]->get_key(j));
+        }
+    }
+
+    long long total = keys.size();
+    int fill = compact_fill(capacity);
+    int target = (total + fill - 1) / fill;
+    if (target < 2 && !root)
+    { // an internal node below the root needs a key
+        target = 2;
+    }
+    if (target < 1)
+    {
+        target = 1;
+    }
+    if (target >= count)
+    {
+        return 0;
+    }
+
+    Node *after = leaves[count - 1]->get_next();
+    for (int j = 0; j < target; j++)
+    {
+        clear_keys(leaves[j]);
+        for (long long k = total * j / target; k < total * (j + 1) / target; k++)
+        {
+            leaves[j]->add_key(keys[k]);
+        }
+    }
+    leaves[target - 1]->set_next(after);
+    if (after != NULL)
+    {
+        after->set_prev(leaves[target - 1]);
+    }
+    for (int j = target; j < count; j++)
+    {
+        STAT_COUNT(STAT_LEAF_COMPACT);
+        retire_node(leaves[j]);
+    }
+
+    clear_keys(node);
+    for (int j = 0; j < capacity + 1; j++)
+    {
+        node->set_child(j < target ? leaves[j] : nullptr, j);
+    }
+    for (int j = 1; j < target; j++)
+    {
+        node->add_key(leaves[j]->get_key(0));
+    }
+    if (root && target == 1)
+    {
+        collapse_root(node);
+    }
+    else
+    {
+        refresh_aggregates(node);
+    }
+    return count - target;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key
+OPERATION   : Descend like find_node until the children are leaves.
+@return the parent of the leaf that holds key, nullptr if
+the root is a leaf.
+************************************************************* */
+Node *find_leaf_parent(Node *node, int key)
+{
+    if (is_leaf(node))
+    {
+        return nullptr;
+    }
+    while (true)
+    {
+        int i = 0;
+        int size = node->get_keysize();
+        while (i < size && key >= node->get_key(i))
+        {
+            i++;
+        }
+        Node *child = node->get_child()[i];
+        if (is_leaf(child))
+        {
+            return node;
+        }
+        node = child;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <climits>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Position of an incremental compaction pass, see compact_step().
+      * key is where the next step resumes, done is set once a step
+      * reached the last leaf, freed counts the leaves dropped so far.
+      */
+    struct CompactCursor
+    {
+        int key;
+        bool done;
+        unsigned long freed;
+
+        CompactCursor() : key(INT_MIN), done(false), freed(0) {}
+    };
+} // namespace Tree
+
+using namespace Tree;
+
+void compact_step(Node* node, CompactCursor& cursor, unsigned int budget);
+
+unsigned long compact_leaves(Node* node);
+
+int compact_parent(Node* node, bool root);
+
+Node* find_leaf_parent(Node* node, int key);
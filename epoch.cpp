@@ -0,0 +1,256 @@
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "epoch.h"
+
+using namespace std;
+
+namespace Tree
+{
+    namespace
+    {
+        /** One slot per thread that ever entered an epoch.
+          * Slots are never unlinked, only released for reuse.
+          */
+        struct EpochSlot
+        {
+            atomic<unsigned long> epoch;
+            atomic<bool> active;
+            atomic<bool> owned;
+            EpochSlot *next;
+        };
+
+        atomic<unsigned long> global_epoch(1);
+        atomic<EpochSlot *> slot_list(nullptr);
+
+        /** Writer lock and version of the trees whose roots hash here,
+          * a cache line each so writers of different trees don't share one.
+          */
+        struct alignas(64) TreeLatch
+        {
+            mutex writer;
+            atomic<unsigned long> version;
+        };
+
+        const size_t LATCH_STRIPES = 256;
+        TreeLatch latches[LATCH_STRIPES];
+
+        TreeLatch &latch_of(Node *root)
+        {
+            uintptr_t address = reinterpret_cast<uintptr_t>(root) >> 6; // drop the offset within a cache line
+            return latches[(address ^ (address >> 8)) % LATCH_STRIPES];
+        }
+
+        mutex retire_mutex;
+        vector<pair<unsigned long, Node *>> retired;
+
+        struct SlotOwner
+        {
+            EpochSlot *slot = nullptr;
+            int depth = 0;
+            ~SlotOwner()
+            {
+                if (slot != nullptr)
+                {
+                    slot->active.store(false);
+                    slot->owned.store(false);
+                }
+            }
+        };
+
+        thread_local SlotOwner owner;
+
+        thread_local bool owned_writes = false;
+        thread_local vector<Node *> owned_retired;
+
+        EpochSlot *acquire_slot()
+        {
+            for (EpochSlot *s = slot_list.load(); s != nullptr; s = s->next)
+            {
+                bool expected = false;
+                if (s->owned.compare_exchange_strong(expected, true))
+                {
+                    return s;
+                }
+            }
+            EpochSlot *s = new EpochSlot();
+            s->epoch.store(0);
+            s->active.store(false);
+            s->owned.store(true);
+            s->next = slot_list.load();
+            while (!slot_list.compare_exchange_weak(s->next, s))
+            {
+            }
+            return s;
+        }
+
+        unsigned long min_active_epoch()
+        {
+            unsigned long min = global_epoch.load();
+            for (EpochSlot *s = slot_list.load(); s != nullptr; s = s->next)
+            {
+                if (s->active.load())
+                {
+                    unsigned long e = s->epoch.load();
+                    if (e < min)
+                    {
+                        min = e;
+                    }
+                }
+            }
+            return min;
+        }
+    } // namespace
+
+    /** Pin the current epoch for the calling thread.
+      * Calls nest; only the outermost enter/exit pair has an effect.
+      */
+    void epoch_enter()
+    {
+        if (owner.depth++ > 0)
+        {
+            return;
+        }
+        if (owner.slot == nullptr)
+        {
+            owner.slot = acquire_slot();
+        }
+        owner.slot->epoch.store(global_epoch.load());
+        owner.slot->active.store(true);
+        // re-read so a writer that advanced the epoch in between is observed
+        owner.slot->epoch.store(global_epoch.load());
+    }
+
+    /** Leave the epoch pinned by epoch_enter()
+      */
+    void epoch_exit()
+    {
+        if (--owner.depth > 0)
+        {
+            return;
+        }
+        owner.slot->active.store(false);
+    }
+
+    /** Hand an unlinked node over for deferred deletion.
+      * The node must already be unreachable from the tree.
+      */
+    void retire_node(Node *node)
+    {
+        if (node == nullptr)
+        {
+            return;
+        }
+        if (owned_writes)
+        {
+            owned_retired.push_back(node);
+            return;
+        }
+        lock_guard<mutex> lock(retire_mutex);
+        retired.push_back(make_pair(global_epoch.load(), node));
+    }
+
+    /** Free every retired node no active reader can still observe
+      */
+    void reclaim_nodes()
+    {
+        lock_guard<mutex> lock(retire_mutex);
+        if (retired.empty())
+        {
+            return;
+        }
+        global_epoch.fetch_add(1);
+        unsigned long safe = min_active_epoch();
+
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < retired.size(); i++)
+        {
+            if (retired[i].first < safe)
+            {
+                delete retired[i].second;
+            }
+            else
+            {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+    /** Number of nodes waiting to be reclaimed
+      */
+    unsigned long retired_count()
+    {
+        lock_guard<mutex> lock(retire_mutex);
+        return retired.size();
+    }
+
+    /** Start a mutation of the tree of root: serialize its writers and
+      * make its version odd before any node is touched.
+      */
+    void write_begin(Node *root)
+    {
+        if (owned_writes)
+        {
+            return;
+        }
+        TreeLatch &latch = latch_of(root);
+        latch.writer.lock();
+        latch.version.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+
+    /** Finish a mutation: make the version even again and reclaim
+      * whatever the mutation retired.
+      */
+    void write_end(Node *root)
+    {
+        if (owned_writes)
+        {
+            for (unsigned int i = 0; i < owned_retired.size(); i++)
+            {
+                delete owned_retired[i];
+            }
+            owned_retired.clear();
+            return;
+        }
+        TreeLatch &latch = latch_of(root);
+        latch.version.fetch_add(1, memory_order_release);
+        latch.writer.unlock();
+        reclaim_nodes();
+    }
+
+    /** Let the calling thread write its own trees without the
+      * writer lock, see OwnerGuard.
+      */
+    void owner_enter()
+    {
+        owned_writes = true;
+    }
+
+    void owner_exit()
+    {
+        owned_writes = false;
+    }
+
+    /** Version of the tree of root to validate an optimistic read
+      * against: the last stable one, without waiting for a writer in
+      * the middle of a mutation, whose changes then fail the read.
+      */
+    unsigned long read_begin(Node *root)
+    {
+        return latch_of(root).version.load(memory_order_acquire) & ~1UL;
+    }
+
+    /** Check that no mutation of the tree happened since read_begin()
+      * @return true if the read observed a consistent tree.
+      */
+    bool read_validate(Node *root, unsigned long version)
+    {
+        atomic_thread_fence(memory_order_acquire);
+        return latch_of(root).version.load(memory_order_relaxed) == version;
+    }
+} // namespace Tree
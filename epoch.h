@@ -0,0 +1,59 @@
+#pragma once
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Epoch-based reclamation and optimistic read versioning.
+      *
+      * Readers pin the current epoch while they touch nodes, so a node
+      * unlinked by a writer is only freed once every reader that could
+      * still hold a pointer to it has left.  Writers of a tree are
+      * serialized by its latch and bump its version around every
+      * mutation; a reader that sees the same even version before and
+      * after its traversal observed a consistent point-in-time view of
+      * the tree. Readers never wait: they start against the last stable
+      * version and only retry if a writer got in between.
+      *
+      * A tree finds its latch by the address of its root node, which
+      * stays the root for the tree's life, in a fixed table; writers of
+      * different trees only share a latch when their roots hash to the
+      * same of its LATCH_STRIPES entries.
+      */
+    void epoch_enter();
+    void epoch_exit();
+
+    class EpochGuard
+    {
+    public:
+        EpochGuard() { epoch_enter(); }
+        ~EpochGuard() { epoch_exit(); }
+        EpochGuard(const EpochGuard &) = delete;
+        EpochGuard &operator=(const EpochGuard &) = delete;
+    };
+
+    void retire_node(Node *node);
+    void reclaim_nodes();
+    unsigned long retired_count();
+
+    void write_begin(Node *root);
+    void write_end(Node *root);
+
+    /** A thread that owns its trees exclusively, with no reader
+      * ever touching them, may skip the writer lock and the version.
+      * Its nodes are then retired to a private list, freed at write_end.
+      */
+    void owner_enter();
+    void owner_exit();
+
+    class OwnerGuard
+    {
+    public:
+        OwnerGuard() { owner_enter(); }
+        ~OwnerGuard() { owner_exit(); }
+        OwnerGuard(const OwnerGuard &) = delete;
+        OwnerGuard &operator=(const OwnerGuard &) = delete;
+    };
+    unsigned long read_begin(Node *root);
+    bool read_validate(Node *root, unsigned long version);
+} // namespace Tree
@@ -0,0 +1,712 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "bulk.h"
+#include "epoch.h"
+#include "split-join.h"
+#include "replay.h"
+#include "external-sort.h"
+
+using namespace std;
+
+namespace
+{
+    const size_t READ_BLOCK = 1 << 20;       // bytes of input parsed at a time
+    const size_t MIN_RUN_BUFFER = 16 * 1024; // keys read from a run at a time, at least
+
+    /** Parses keys from a stream: whitespace separated integers, '#'
+      * comments to the end of the line, or raw little-endian int32.
+      */
+    class KeyReader
+    {
+    public:
+        KeyReader(istream &in, bool binary) : in_(in), binary_(binary), buffer_(READ_BLOCK), pos_(0), len_(0), failed_(false) {}
+
+        /** @return false at the end of input or on a malformed key,
+          * see failed().
+          */
+        bool next(int &key)
+        {
+            return binary_ ? next_binary(key) : next_text(key);
+        }
+
+        bool failed() const
+        {
+            return failed_;
+        }
+
+    private:
+        /** Move the unread bytes to the front and read behind them
+          * @return false if nothing is left.
+          */
+        bool fill()
+        {
+            size_t rest = len_ - pos_;
+            memmove(buffer_.data(), buffer_.data() + pos_, rest);
+            pos_ = 0;
+            len_ = rest;
+            if (in_)
+            {
+                in_.read(buffer_.data() + len_, buffer_.size() - len_);
+                len_ += in_.gcount();
+            }
+            return len_ > 0;
+        }
+
+        bool next_binary(int &key)
+        {
+            if (len_ - pos_ < sizeof(int) && !fill())
+            {
+                return false;
+            }
+            if (len_ - pos_ < sizeof(int))
+            { // trailing partial key
+                failed_ = true;
+                return false;
+            }
+            memcpy(&key, buffer_.data() + pos_, sizeof(int));
+            pos_ += sizeof(int);
+            return true;
+        }
+
+        bool peek(char &c)
+        {
+            if (pos_ == len_ && !fill())
+            {
+                return false;
+            }
+            c = buffer_[pos_];
+            return true;
+        }
+
+        bool next_text(int &key)
+        {
+            char c;
+            while (peek(c))
+            {
+                if (c == '#')
+                {
+                    while (peek(c) && c != '\n')
+                    {
+                        pos_++;
+                    }
+                }
+                else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                {
+                    pos_++;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            if (!peek(c))
+            {
+                return false;
+            }
+
+            bool negative = c == '-';
+            pos_ += negative;
+            long long value = 0;
+            int digits = 0;
+            while (peek(c) && c >= '0' && c <= '9')
+            {
+                value = value * 10 + (c - '0');
+                pos_++;
+                if (++digits > 10)
+                {
+                    break;
+                }
+            }
+            value = negative ? -value : value;
+            bool separated = !peek(c) || c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#';
+            if (digits == 0 || !separated || value < INT_MIN || value > INT_MAX)
+            {
+                failed_ = true;
+                return false;
+            }
+            key = static_cast<int>(value);
+            return true;
+        }
+
+        istream &in_;
+        bool binary_;
+        vector<char> buffer_;
+        size_t pos_;
+        size_t len_;
+        bool failed_;
+    };
+
+    /** Temporary file of sorted keys, unlinked on creation and gone
+      * once closed.
+      */
+    class RunFile
+    {
+    public:
+        RunFile(const string &dir) : fd_(-1), bytes_(0)
+        {
+            string path = dir + "/bpt-run-XXXXXX";
+            fd_ = mkstemp(&path[0]);
+            if (fd_ >= 0)
+            {
+                unlink(path.c_str());
+            }
+        }
+
+        ~RunFile()
+        {
+            if (fd_ >= 0)
+            {
+                close(fd_);
+            }
+        }
+
+        RunFile(const RunFile &) = delete;
+        RunFile &operator=(const RunFile &) = delete;
+
+        bool is_open()
+        {
+            return fd_ >= 0;
+        }
+
+        bool append(const int *keys, size_t count)
+        {
+            const char *bytes = reinterpret_cast<const char *>(keys);
+            size_t done = 0;
+            while (done < count * sizeof(int))
+            {
+                ssize_t written = pwrite(fd_, bytes + done, count * sizeof(int) - done, bytes_ + done);
+                if (written <= 0)
+                {
+                    return false;
+                }
+                done += written;
+            }
+            bytes_ += done;
+            return true;
+        }
+
+        /** Read keys [offset, offset + count) of the run
+          * @return number of keys read.
+          */
+        size_t read(int *keys, size_t offset, size_t count)
+        {
+            count = min(count, size() - offset);
+            char *bytes = reinterpret_cast<char *>(keys);
+            size_t done = 0;
+            while (done < count * sizeof(int))
+            {
+                ssize_t got = pread(fd_, bytes + done, count * sizeof(int) - done, offset * sizeof(int) + done);
+                if (got <= 0)
+                {
+                    break;
+                }
+                done += got;
+            }
+            return done / sizeof(int);
+        }
+
+        /** @return number of keys in the run.
+          */
+        size_t size()
+        {
+            return bytes_ / sizeof(int);
+        }
+
+    private:
+        int fd_;
+        size_t bytes_;
+    };
+
+    /** Buffered sequential reader over one run
+      */
+    class RunReader
+    {
+    public:
+        RunReader(RunFile *run, size_t buffer) : run_(run), offset_(0), buffer_(buffer), pos_(0), len_(0) {}
+
+        bool next(int &key)
+        {
+            if (pos_ == len_)
+            {
+                len_ = run_->read(buffer_.data(), offset_, buffer_.size());
+                offset_ += len_;
+                pos_ = 0;
+                if (len_ == 0)
+                {
+                    return false;
+                }
+            }
+            key = buffer_[pos_++];
+            return true;
+        }
+
+        bool finished()
+        {
+            return offset_ == run_->size();
+        }
+
+    private:
+        RunFile *run_;
+        size_t offset_;
+        vector<int> buffer_;
+        size_t pos_;
+        size_t len_;
+    };
+
+    /** Buffered writer of one run, dropping repeated keys
+      */
+    class RunWriter
+    {
+    public:
+        RunWriter(RunFile *run, size_t buffer) : run_(run), limit_(buffer), last_(0), ok_(true)
+        {
+            buffer_.reserve(buffer);
+        }
+
+        void add(int key)
+        {
+            if (!buffer_.empty() ? buffer_.back() == key : last_ == key && run_->size() > 0)
+            {
+                return;
+            }
+            buffer_.push_back(key);
+            if (buffer_.size() == limit_)
+            {
+                flush();
+            }
+        }
+
+        bool flush()
+        {
+            if (!buffer_.empty())
+            {
+                last_ = buffer_.back();
+                ok_ = ok_ && run_->append(buffer_.data(), buffer_.size());
+                buffer_.clear();
+            }
+            return ok_;
+        }
+
+    private:
+        RunFile *run_;
+        vector<int> buffer_;
+        size_t limit_;
+        int last_; // last key flushed
+        bool ok_;
+    };
+
+    /** ************************************************************
+    INPUT       : runs [first, last), read buffer per run in keys, sink
+    with add(int)
+    OPERATION   : k-way merge through a heap of the current key of
+    every run.
+    @return false if a run could not be read back whole.
+    ************************************************************* */
+    template <typename Sink>
+    bool merge_runs(vector<unique_ptr<RunFile>> &runs, size_t first, size_t last, size_t buffer, Sink &sink)
+    {
+        typedef pair<int, size_t> Head; // key, reader
+        priority_queue<Head, vector<Head>, greater<Head>> heads;
+        vector<unique_ptr<RunReader>> readers;
+        for (size_t r = first; r < last; r++)
+        {
+            readers.emplace_back(new RunReader(runs[r].get(), buffer));
+            int key;
+            if (readers.back()->next(key))
+            {
+                heads.push(Head(key, readers.size() - 1));
+            }
+        }
+        while (!heads.empty())
+        {
+            Head head = heads.top();
+            heads.pop();
+            sink.add(head.first);
+            int key;
+            if (readers[head.second]->next(key))
+            {
+                heads.push(Head(key, head.second));
+            }
+        }
+        for (unsigned int r = 0; r < readers.size(); r++)
+        {
+            if (!readers[r]->finished())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void usage()
+    {
+        cout << "usage: b-plus-tree --build <keys | -> [--capacity N] [--memory MB] [--binary] [--validate]" << endl;
+    }
+
+    /** ************************************************************
+    INPUT       : --memory argument in MB, sort bounds to set
+    OPERATION   : Parse the memory bound, reporting one that is not a
+    positive number or does not fit in bytes.
+    @return false if the argument is not a valid bound.
+    ************************************************************* */
+    bool parse_memory(const char *arg, ExternalSortOptions &options)
+    {
+        char *end;
+        errno = 0;
+        unsigned long long megabytes = strtoull(arg, &end, 10);
+        if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-' ||
+            megabytes == 0 || megabytes > (SIZE_MAX >> 20))
+        {
+            cout << "memory should be a positive number of MB" << endl;
+            return false;
+        }
+        options.memory = static_cast<size_t>(megabytes) << 20;
+        return true;
+    }
+} // namespace
+
+namespace Tree
+{
+    StreamBuilder::StreamBuilder(unsigned int capacity) : capacity_(capacity), leaf_(nullptr), leaf_low_(0), size_(0) {}
+
+    /** Free whatever an unfinished build has put together
+      */
+    StreamBuilder::~StreamBuilder()
+    {
+        if (leaf_ != nullptr)
+        {
+            delete leaf_;
+        }
+        for (unsigned int level = 0; level < open_.size(); level++)
+        {
+            if (open_[level] != nullptr)
+            {
+                write_begin(open_[level]);
+                free_subtree(open_[level]);
+                write_end(open_[level]);
+            }
+        }
+    }
+
+    /** Append a key to the last leaf, starting a new one once it is
+      * full. Keys must come in ascending order, a key not above the
+      * previous one is skipped.
+      */
+    void StreamBuilder::add(int key)
+    {
+        if (leaf_ != nullptr && key <= leaf_->get_key(leaf_->get_keysize() - 1))
+        {
+            return;
+        }
+        if (leaf_ == nullptr || leaf_->get_keysize() == static_cast<int>(capacity_) - 1)
+        {
+            Node *leaf = new Node(capacity_);
+            leaf->set_type(TREE_LEAF);
+            if (leaf_ != nullptr)
+            {
+                leaf_->set_next(leaf);
+                leaf->set_prev(leaf_);
+                push(0, leaf_, leaf_low_);
+            }
+            leaf_ = leaf;
+            leaf_low_ = key;
+        }
+        leaf_->add_key(key);
+        size_++;
+    }
+
+    /** ************************************************************
+    INPUT       : level above the leaves, node of the level below, the
+    smallest key under it
+    OPERATION   : Make node the next child of the open node of level.
+    A full open node is closed first, handed to the level
+    above, and replaced by a new one.
+    ************************************************************* */
+    void StreamBuilder::push(unsigned int level, Node *node, int low)
+    {
+        if (level == open_.size())
+        {
+            open_.push_back(nullptr);
+            low_.push_back(0);
+        }
+        Node *parent = open_[level];
+        if (parent != nullptr && parent->get_keysize() == static_cast<int>(capacity_) - 1)
+        {
+            push(level + 1, parent, low_[level]);
+            parent = nullptr;
+        }
+        if (parent == nullptr)
+        {
+            parent = new Node(capacity_);
+            parent->set_type(TREE_INTERNAL);
+            parent->set_child(node, 0);
+            open_[level] = parent;
+            low_[level] = low;
+            return;
+        }
+        parent->add_key(low);
+        parent->set_child(node, parent->get_keysize());
+    }
+
+    /** Move the last child of the left sibling of the open node of
+      * level, the last child of the open node above, in front of its
+      * single child.
+      */
+    void StreamBuilder::borrow(unsigned int level)
+    {
+        Node *node = open_[level];
+        Node *parent = open_[level + 1];
+        Node *sibling = parent->get_child()[parent->get_keysize()];
+        int last = sibling->get_keysize();
+        Node *moved = sibling->get_child()[last];
+        int moved_low = sibling->get_key(last - 1);
+        sibling->del_child(last);
+        sibling->del_key(moved_low);
+        node->add_key(low_[level]);
+        node->set_child(node->get_child()[0], 1);
+        node->set_child(moved, 0);
+        low_[level] = moved_low;
+    }
+
+    /** ************************************************************
+    OPERATION   : Close the last leaf and the open nodes bottom-up. The
+    builder is empty afterwards.
+    @return root of the tree, an empty root leaf without keys.
+    ************************************************************* */
+    Node *StreamBuilder::finish()
+    {
+        Node *root;
+        if (leaf_ == nullptr)
+        {
+            root = new Node(capacity_);
+        }
+        else if (open_.empty())
+        {
+            root = leaf_;
+            root->set_type(TREE_ROOT_LEAF);
+        }
+        else
+        {
+            push(0, leaf_, leaf_low_);
+            for (unsigned int level = 0; level + 1 < open_.size(); level++)
+            {
+                if (open_[level]->get_keysize() == 0)
+                {
+                    borrow(level);
+                }
+                push(level + 1, open_[level], low_[level]);
+            }
+            root = open_.back();
+            root->set_type(TREE_ROOT_INTERNAL);
+        }
+        leaf_ = nullptr;
+        size_ = 0;
+        open_.clear();
+        low_.clear();
+        return root;
+    }
+
+    /** @return number of keys added since the last finish().
+      */
+    unsigned long long StreamBuilder::size()
+    {
+        return size_;
+    }
+} // namespace Tree
+
+/** ************************************************************
+INPUT       : unsorted keys, capacity of the tree, memory bound and
+run directory
+OPERATION   : External merge sort streamed into a StreamBuilder.
+Input is read in runs of memory / 4 keys, every run is
+sorted, stripped of repeats and written to its own file.
+With more than one thread the runs are memory / 8 keys, as
+the merge of the sorted chunks takes a buffer of the run's
+size.
+Runs are merged as many at a time as read buffers of at
+least 64KB fit in memory, in extra passes if there are
+more, and the last merge feeds the builder directly, so
+the sorted keys never exist anywhere but in the tree.
+Input that fits a single run skips the files altogether.
+@return root of the tree, nullptr on a malformed key or a
+failing run file.
+************************************************************* */
+Node *external_build(istream &in, unsigned int capacity, const ExternalSortOptions &options)
+{
+    size_t budget = max(options.memory / sizeof(int), 2 * MIN_RUN_BUFFER);
+    KeyReader reader(in, options.binary);
+    StreamBuilder builder(capacity);
+    vector<unique_ptr<RunFile>> runs;
+    size_t run = options.threads > 1 ? budget / 2 : budget;
+    vector<int> keys;
+    keys.reserve(run);
+
+    bool more = true;
+    while (more)
+    {
+        keys.clear();
+        int key;
+        while (keys.size() < run && (more = reader.next(key)))
+        {
+            keys.push_back(key);
+        }
+        if (reader.failed())
+        {
+            return nullptr;
+        }
+        parallel_sort(keys, options.threads);
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        if (!more && runs.empty())
+        { // everything fit
+            for (unsigned int i = 0; i < keys.size(); i++)
+            {
+                builder.add(keys[i]);
+            }
+            return builder.finish();
+        }
+        if (!keys.empty())
+        {
+            runs.emplace_back(new RunFile(options.temp_dir));
+            if (!runs.back()->is_open() || !runs.back()->append(keys.data(), keys.size()))
+            {
+                return nullptr;
+            }
+        }
+    }
+    vector<int>().swap(keys);
+
+    size_t fan_in = budget / MIN_RUN_BUFFER;
+    while (runs.size() > fan_in)
+    {
+        vector<unique_ptr<RunFile>> merged;
+        size_t buffer = budget / (fan_in + 1);
+        for (size_t first = 0; first < runs.size(); first += fan_in)
+        {
+            size_t last = min(first + fan_in, runs.size());
+            merged.emplace_back(new RunFile(options.temp_dir));
+            RunWriter writer(merged.back().get(), buffer);
+            if (!merged.back()->is_open() || !merge_runs(runs, first, last, buffer, writer) || !writer.flush())
+            {
+                return nullptr;
+            }
+            for (size_t r = first; r < last; r++)
+            {
+                runs[r].reset(); // closes and frees the run
+            }
+        }
+        runs.swap(merged);
+    }
+    if (!merge_runs(runs, 0, runs.size(), budget / max<size_t>(runs.size(), 1), builder))
+    {
+        return nullptr;
+    }
+    return builder.finish();
+}
+
+/** ************************************************************
+INPUT       : command line arguments
+OPERATION   : --build builds a tree from unsorted keys in a file or
+stdin through external_build(), timed, sorting the runs
+with every hardware thread.
+@return process exit code.
+************************************************************* */
+int build_main(int argc, char **argv)
+{
+    string source;
+    unsigned int capacity = 64;
+    bool check = false;
+    ExternalSortOptions options;
+    options.threads = thread::hardware_concurrency();
+    if (getenv("TMPDIR") != nullptr)
+    {
+        options.temp_dir = getenv("TMPDIR");
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--build" && i + 1 < argc)
+        {
+            source = argv[++i];
+        }
+        else if (arg == "--capacity" && i + 1 < argc)
+        {
+            if (!parse_capacity(argv[++i], capacity))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--memory" && i + 1 < argc)
+        {
+            if (!parse_memory(argv[++i], options))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--binary")
+        {
+            options.binary = true;
+        }
+        else if (arg == "--validate")
+        {
+            check = true;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (source.empty())
+    {
+        usage();
+        return 1;
+    }
+    ifstream file;
+    istream *in = open_input(source, file);
+    if (in == nullptr)
+    {
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Node *root = external_build(*in, capacity, options);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (root == nullptr)
+    {
+        cout << "build failed: malformed key or run file error" << endl;
+        return 1;
+    }
+    long long keys = 0;
+    for (Node *leaf = get_leftmost_leaf(root); leaf != nullptr; leaf = leaf->get_next())
+    {
+        keys += leaf->get_keysize();
+    }
+    cout << keys << " keys in " << seconds << " s" << endl;
+    bool valid = !check || validate(root);
+    if (!valid)
+    {
+        cout << "validation failed" << endl;
+    }
+    write_begin(root);
+    free_subtree(root);
+    write_end(root);
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Bounds of external_build().
+      *
+      * memory caps the keys held at once, in bytes: the run being sorted
+      * with the merge buffer of a threaded sort, and later the read
+      * buffers of the runs being merged. Runs go to temp_dir and are
+      * unlinked as soon as they are created, so nothing is left behind,
+      * not even after a crash.
+      */
+    struct ExternalSortOptions
+    {
+        size_t memory;
+        unsigned int threads; // sorting one run
+        bool binary;          // little-endian int32 keys instead of text
+        std::string temp_dir;
+
+        ExternalSortOptions() : memory(size_t(256) << 20), threads(1), binary(false), temp_dir("/tmp") {}
+    };
+
+    /** Builds a tree bottom-up from keys arriving in ascending order,
+      * without holding them anywhere but in the tree.
+      *
+      * Leaves are filled up to capacity - 1 keys and chained as they
+      * close. Every level above keeps only the node it is filling: a
+      * full node is handed to the level above once its next sibling is
+      * started, so the builder holds one open node per level. finish()
+      * closes the open nodes bottom-up; the last node of a level that
+      * got a single child borrows one from its left sibling, which is
+      * always full, so the tree keeps the shape of bulk_build().
+      */
+    class StreamBuilder
+    {
+    public:
+        StreamBuilder(unsigned int capacity);
+        ~StreamBuilder();
+        StreamBuilder(const StreamBuilder &) = delete;
+        StreamBuilder &operator=(const StreamBuilder &) = delete;
+
+        void add(int key);
+        Node *finish();
+        unsigned long long size();
+
+    private:
+        void push(unsigned int level, Node *node, int low);
+        void borrow(unsigned int level);
+
+        unsigned int capacity_;
+        Node *leaf_;
+        int leaf_low_;
+        unsigned long long size_;
+        std::vector<Node *> open_; // node being filled on every internal level
+        std::vector<int> low_;     // smallest key under it
+    };
+} // namespace Tree
+
+using namespace Tree;
+
+Node* external_build(istream& in, unsigned int capacity, const ExternalSortOptions& options);
+
+int build_main(int argc, char** argv);
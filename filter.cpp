@@ -0,0 +1,219 @@
+#include "node.h"
+#include "b-plus-tree.h"
+#include "upsert.h"
+#include "filter.h"
+
+using namespace std;
+
+namespace
+{
+    const unsigned int COUNTER_MAX = 15;
+
+    /** splitmix64 finalizer, spreads consecutive keys over the filter
+      */
+    uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+} // namespace
+
+namespace Tree
+{
+    /** Empty filter sized for about expected keys
+      */
+    KeyFilter::KeyFilter(unsigned long expected, unsigned int bits_per_key)
+    {
+        init(expected, bits_per_key);
+    }
+
+    /** Filter over every key of a tree, e.g. right after bulk_build
+      */
+    KeyFilter::KeyFilter(Node *root, unsigned int bits_per_key)
+    {
+        vector<int> keys;
+        for (Node *leaf = get_leftmost_leaf(root); leaf != NULL; leaf = leaf->get_next())
+        {
+            for (int i = 0; i < leaf->get_keysize(); i++)
+            {
+                keys.push_back(leaf->get_key(i));
+            }
+        }
+        init(keys.size(), bits_per_key);
+        for (unsigned int i = 0; i < keys.size(); i++)
+        {
+            add(keys[i]);
+        }
+    }
+
+    void KeyFilter::init(unsigned long expected, unsigned int bits_per_key)
+    {
+        if (bits_per_key < 1)
+        {
+            bits_per_key = 1;
+        }
+        slots_ = expected * bits_per_key;
+        if (slots_ < 64)
+        {
+            slots_ = 64;
+        }
+        probes_ = static_cast<unsigned int>(bits_per_key * 0.69 + 0.5); // k = m / n * ln 2
+        if (probes_ < 1)
+        {
+            probes_ = 1;
+        }
+        if (probes_ > 16)
+        {
+            probes_ = 16;
+        }
+        counter_.assign((slots_ + 1) / 2, 0);
+        empty_ = true;
+        min_ = 0;
+        max_ = 0;
+    }
+
+    unsigned int KeyFilter::counter(uint64_t slot) const
+    {
+        return (counter_[slot / 2] >> (slot % 2 * 4)) & 0xf;
+    }
+
+    void KeyFilter::set_counter(uint64_t slot, unsigned int value)
+    {
+        uint8_t &byte = counter_[slot / 2];
+        int shift = slot % 2 * 4;
+        byte = (byte & ~(0xf << shift)) | (value << shift);
+    }
+
+    /** Count key in, and widen the fences to it
+      */
+    void KeyFilter::add(int key)
+    {
+        uint64_t hash = mix(static_cast<uint32_t>(key));
+        uint64_t step = (hash >> 32) | 1;
+        for (unsigned int i = 0; i < probes_; i++)
+        {
+            uint64_t slot = (hash + i * step) % slots_;
+            unsigned int value = counter(slot);
+            if (value < COUNTER_MAX)
+            {
+                set_counter(slot, value + 1);
+            }
+        }
+        if (empty_ || key < min_)
+        {
+            min_ = key;
+        }
+        if (empty_ || key > max_)
+        {
+            max_ = key;
+        }
+        empty_ = false;
+    }
+
+    /** Count a present key out. Saturated counters are left alone,
+      * they no longer know how many keys share them.
+      */
+    void KeyFilter::remove(int key)
+    {
+        uint64_t hash = mix(static_cast<uint32_t>(key));
+        uint64_t step = (hash >> 32) | 1;
+        for (unsigned int i = 0; i < probes_; i++)
+        {
+            uint64_t slot = (hash + i * step) % slots_;
+            unsigned int value = counter(slot);
+            if (value > 0 && value < COUNTER_MAX)
+            {
+                set_counter(slot, value - 1);
+            }
+        }
+    }
+
+    /** @return false only if key is certainly not in the tree.
+      */
+    bool KeyFilter::may_contain(int key) const
+    {
+        if (empty_ || key < min_ || key > max_)
+        {
+            return false;
+        }
+        uint64_t hash = mix(static_cast<uint32_t>(key));
+        uint64_t step = (hash >> 32) | 1;
+        for (unsigned int i = 0; i < probes_; i++)
+        {
+            if (counter((hash + i * step) % slots_) == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** @return false only if no key of [lo, hi] can be in the tree.
+      */
+    bool KeyFilter::may_intersect(int lo, int hi) const
+    {
+        return !empty_ && lo <= hi && lo <= max_ && hi >= min_;
+    }
+
+    size_t KeyFilter::memory() const
+    {
+        return sizeof(*this) + counter_.capacity();
+    }
+} // namespace Tree
+
+/** ************************************************************
+INPUT       : Root node pointer, filter of the tree, integer key
+OPERATION   : Reject absent keys in the filter, before any node
+is touched, and descend only for possible hits.
+************************************************************* */
+bool find_filtered(Node *node, const KeyFilter &filter, int key)
+{
+    return filter.may_contain(key) && find_node(node, key);
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, filter of the tree, integer key
+OPERATION   : Insert a key unless it is present and count it into
+the filter. Only a key that is really added is counted in,
+see delete_filtered().
+@return true if key was inserted.
+************************************************************* */
+bool insert_filtered(Node *node, KeyFilter &filter, int key)
+{
+    if (!try_insert(node, key))
+    {
+        return false;
+    }
+    filter.add(key);
+    return true;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, filter of the tree, integer key
+OPERATION   : Delete a key and count it out of the filter. Only
+a key that is really present is counted out, counting
+out an absent key would make the filter lie about others.
+************************************************************* */
+Node *delete_filtered(Node *node, KeyFilter &filter, int key)
+{
+    if (!filter.may_contain(key) || !find_node(node, key))
+    {
+        return node;
+    }
+    node = delete_node(node, key);
+    filter.remove(key);
+    return node;
+}
+
+/** Scan [lo, hi] unless the fences rule the range out
+  */
+vector<int> range_scan_filtered(Node *node, const KeyFilter &filter, int lo, int hi)
+{
+    if (!filter.may_intersect(lo, hi))
+    {
+        return vector<int>();
+    }
+    return range_scan(node, lo, hi);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Negative-lookup filter for a whole tree.
+      *
+      * A counting Bloom filter with 4-bit counters answers "certainly
+      * absent" for most missing keys, and min/max fences reject ranges
+      * outside the keys ever inserted. Counters make deletes possible;
+      * a counter that saturates stays put, which only costs false
+      * positives. Fences only widen, so after deletes they may be loose
+      * until the filter is rebuilt from the tree.
+      */
+    class KeyFilter
+    {
+    public:
+        KeyFilter(unsigned long expected, unsigned int bits_per_key = 10);
+        KeyFilter(Node *root, unsigned int bits_per_key = 10);
+
+        void add(int key);
+        void remove(int key);
+        bool may_contain(int key) const;
+        bool may_intersect(int lo, int hi) const;
+        size_t memory() const;
+
+    private:
+        void init(unsigned long expected, unsigned int bits_per_key);
+        unsigned int counter(uint64_t slot) const;
+        void set_counter(uint64_t slot, unsigned int value);
+
+        std::vector<uint8_t> counter_; // two 4-bit counters per byte
+        uint64_t slots_;
+        unsigned int probes_;
+        bool empty_;
+        int min_;
+        int max_;
+    };
+} // namespace Tree
+
+using namespace Tree;
+
+bool find_filtered(Node* node, const KeyFilter& filter, int key);
+
+bool insert_filtered(Node* node, KeyFilter& filter, int key);
+
+Node* delete_filtered(Node* node, KeyFilter& filter, int key);
+
+vector<int> range_scan_filtered(Node* node, const KeyFilter& filter, int lo, int hi);
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "bulk.h"
+#include "epoch.h"
+#include "split-join.h"
+#include "fixed-capacity.h"
+
+using namespace std;
+
+namespace
+{
+    /** find_node() with the search loops picked by FIXED, so both
+      * paths can be timed on the same tree in one binary.
+      */
+    template <bool FIXED>
+    bool descend_find(Node *node, int key)
+    {
+        while (node->get_type() != TREE_LEAF && node->get_type() != TREE_ROOT_LEAF)
+        {
+            const int *keys = node->get_keys();
+            int size = node->get_keysize();
+            int i = FIXED ? key_rank<true>(keys, size, node->get_capacity(), key) : rank_generic<true>(keys, size, key);
+            node = node->get_child()[i];
+        }
+        const int *keys = node->get_keys();
+        int size = node->get_keysize();
+        int i = FIXED ? key_rank<false>(keys, size, node->get_capacity(), key) : rank_generic<false>(keys, size, key);
+        return i < size && keys[i] == key;
+    }
+
+    /** @return best nanoseconds per lookup over rounds runs.
+      */
+    template <bool FIXED>
+    double time_lookups(Node *root, const vector<int> &queries, int rounds, long long &hits)
+    {
+        double best = 0;
+        for (int round = 0; round < rounds; round++)
+        {
+            hits = 0;
+            auto start = chrono::steady_clock::now();
+            for (unsigned int i = 0; i < queries.size(); i++)
+            {
+                hits += descend_find<FIXED>(root, queries[i]);
+            }
+            double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / queries.size();
+            best = round == 0 ? ns : min(best, ns);
+        }
+        return best;
+    }
+} // namespace
+
+/** ************************************************************
+OPERATION   : Build a tree of 1M random keys at every capacity with
+a fixed kernel and time 2M random lookups through the
+generic early-exit loops and through key_rank(), best of
+three rounds each, on the same tree.
+************************************************************* */
+void print_kernel_bench()
+{
+    const int KEYS = 1000000;
+    const int LOOKUPS = 2000000;
+    mt19937 random(1);
+    vector<int> keys(KEYS);
+    for (int i = 0; i < KEYS; i++)
+    {
+        keys[i] = static_cast<int>(random() >> 1);
+    }
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    vector<int> queries(LOOKUPS);
+    for (int i = 0; i < LOOKUPS; i++)
+    { // half of them hits
+        queries[i] = i % 2 == 0 ? keys[random() % keys.size()] : static_cast<int>(random() >> 1);
+    }
+
+    cout << setw(10) << "capacity" << setw(14) << "generic ns" << setw(12) << "fixed ns" << setw(10) << "speedup" << endl;
+    for (int capacity : {15, 16, 31, 32, 63, 64, 127, 128})
+    {
+        Node *root = bulk_build(keys, capacity, 1);
+        long long generic_hits = 0;
+        long long fixed_hits = 0;
+        double generic_ns = time_lookups<false>(root, queries, 3, generic_hits);
+        double fixed_ns = time_lookups<true>(root, queries, 3, fixed_hits);
+        cout << setw(10) << capacity << fixed << setprecision(1)
+             << setw(14) << generic_ns << setw(12) << fixed_ns << setprecision(2) << setw(9) << generic_ns / fixed_ns << "x";
+        cout.unsetf(ios::floatfield);
+        cout << setprecision(6);
+        if (generic_hits != fixed_hits)
+        {
+            cout << "  results differ";
+        }
+        cout << endl;
+        write_begin(root);
+        free_subtree(root);
+        write_end(root);
+    }
+}
+
+/** ************************************************************
+INPUT       : command line arguments
+OPERATION   : --kernels runs print_kernel_bench().
+@return process exit code.
+************************************************************* */
+int kernels_main(int argc, char **argv)
+{
+    if (argc != 2 || string(argv[1]) != "--kernels")
+    {
+        cout << "usage: b-plus-tree --kernels" << endl;
+        return 1;
+    }
+    print_kernel_bench();
+    return 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+namespace Tree
+{
+    /** Key search kernels specialized for common capacities.
+      *
+      * The capacity of a node is only known at run time, so a search
+      * loop over its keys runs to a runtime bound and exits early, which
+      * keeps the compiler from unrolling or vectorizing it. For the
+      * capacities below, key_rank() dispatches to an instance whose trip
+      * count is the capacity itself: every slot is compared and the
+      * slots past size are masked off, which compiles to straight-line
+      * SIMD compares without a data-dependent branch, and the cache-line
+      * sized capacities one below, 15 .. 127 as picked by --tune, share
+      * the kernels. Other capacities, or builds with -DBPT_GENERIC_SEARCH,
+      * take the early-exit loop.
+      *
+      * The kernels read every slot up to the capacity rounded as above,
+      * past size: key_rank() must be given a block of capacity + 1
+      * initialized slots. Node key blocks are exactly that (Node::Node
+      * fills them with INT_MAX); any other array goes to rank_generic().
+      *
+      * Only the search is specialized. The shifts of Node::add_key() and
+      * del_key() and the key moves of splits and merges write every slot
+      * with store_slot(), one atomic store each so that optimistic readers
+      * never see a torn key (see epoch.h). The compiler neither unrolls
+      * nor vectorizes those, so a fixed trip count would only add stores
+      * past size; they run to the runtime bound.
+      */
+
+    /** @return number of the first size keys below key, or not above it
+      * with INCLUSIVE, stopping at the first one that is not.
+      */
+    template <bool INCLUSIVE>
+    inline int rank_generic(const int *keys, int size, int key)
+    {
+        int i = 0;
+        while (i < size && (INCLUSIVE ? keys[i] <= key : keys[i] < key))
+        {
+            i++;
+        }
+        return i;
+    }
+
+    /** rank_generic() over exactly CAPACITY slots, without early exit
+      */
+    template <int CAPACITY, bool INCLUSIVE>
+    inline int rank_fixed(const int *keys, int size, int key)
+    {
+        int count = 0;
+        for (int i = 0; i < CAPACITY; i++)
+        {
+            count += (i < size) & (INCLUSIVE ? keys[i] <= key : keys[i] < key);
+        }
+        return count;
+    }
+
+    /** Rank of key among the ascending keys of a node of capacity.
+      * With INCLUSIVE it is the child to descend into on insert, delete
+      * and find, where a key equal to a separator goes right; without,
+      * the position of the first key >= key.
+      */
+    template <bool INCLUSIVE>
+    inline int key_rank(const int *keys, int size, int capacity, int key)
+    {
+#ifdef BPT_GENERIC_SEARCH
+        (void)capacity;
+#else
+        switch (size <= capacity ? capacity : 0)
+        {
+        case 15:
+        case 16:
+            return rank_fixed<16, INCLUSIVE>(keys, size, key);
+        case 31:
+        case 32:
+            return rank_fixed<32, INCLUSIVE>(keys, size, key);
+        case 63:
+        case 64:
+            return rank_fixed<64, INCLUSIVE>(keys, size, key);
+        case 127:
+        case 128:
+            return rank_fixed<128, INCLUSIVE>(keys, size, key);
+        }
+#endif
+        return rank_generic<INCLUSIVE>(keys, size, key);
+    }
+} // namespace Tree
+
+void print_kernel_bench();
+
+int kernels_main(int argc, char** argv);
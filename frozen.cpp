@@ -0,0 +1,131 @@
+#include <climits>
+#include <cstdlib>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "frozen.h"
+
+using namespace std;
+
+namespace Tree
+{
+    /** Freeze a built tree.
+      * The leaf chain is read once, the tree itself is not modified
+      * and may be freed or changed afterwards.
+      */
+    FrozenTree::FrozenTree(Node *root)
+        : key_(nullptr), blocks_(0), size_(0), has_max_(false)
+    {
+        vector<int> sorted;
+        for (Node *leaf = get_leftmost_leaf(root); leaf != NULL; leaf = leaf->get_next())
+        {
+            for (int i = 0; i < leaf->get_keysize(); i++)
+            {
+                sorted.push_back(leaf->get_key(i));
+            }
+        }
+        size_ = sorted.size();
+        has_max_ = size_ > 0 && sorted.back() == INT_MAX;
+        blocks_ = (size_ + BLOCK - 1) / BLOCK;
+
+        size_t bytes = static_cast<size_t>(blocks_ > 0 ? blocks_ : 1) * BLOCK * sizeof(int);
+        key_ = static_cast<int *>(aligned_alloc(64, bytes)); // blocks start on cache lines
+        int next = 0;
+        fill(0, sorted.data(), next);
+    }
+
+    FrozenTree::~FrozenTree()
+    {
+        free(key_);
+    }
+
+    /** Lay out keys in order: child 0, key 0, child 1, key 1, ...
+      * Slots behind the last key are padded with INT_MAX.
+      */
+    void FrozenTree::fill(int block, const int *sorted, int &next)
+    {
+        if (block >= blocks_)
+        {
+            return;
+        }
+        for (int i = 0; i < BLOCK; i++)
+        {
+            fill(block * (BLOCK + 1) + i + 1, sorted, next);
+            key_[block * BLOCK + i] = next < size_ ? sorted[next++] : INT_MAX;
+        }
+        fill(block * (BLOCK + 1) + BLOCK + 1, sorted, next);
+    }
+
+    /** Count keys of a block that are smaller than key
+      * @return index of the first key >= key, BLOCK if none.
+      */
+    int FrozenTree::rank(const int *block, int key)
+    {
+#if defined(__AVX2__)
+        __m256i x = _mm256_set1_epi32(key);
+        __m256i lo = _mm256_cmpgt_epi32(x, _mm256_load_si256(reinterpret_cast<const __m256i *>(block)));
+        __m256i hi = _mm256_cmpgt_epi32(x, _mm256_load_si256(reinterpret_cast<const __m256i *>(block + 8)));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(lo)) | _mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8;
+        return __builtin_popcount(mask);
+#elif defined(__SSE2__)
+        __m128i x = _mm_set1_epi32(key);
+        int mask = 0;
+        for (int i = 0; i < BLOCK; i += 4)
+        {
+            __m128i less = _mm_cmpgt_epi32(x, _mm_load_si128(reinterpret_cast<const __m128i *>(block + i)));
+            mask |= _mm_movemask_ps(_mm_castsi128_ps(less)) << i;
+        }
+        return __builtin_popcount(mask);
+#else
+        int count = 0;
+        for (int i = 0; i < BLOCK; i++)
+        {
+            count += block[i] < key;
+        }
+        return count;
+#endif
+    }
+
+    /** Find the smallest key >= key
+      * @return false if every key is smaller.
+      */
+    bool FrozenTree::lower_bound(int key, int &result) const
+    {
+        bool found = false;
+        int block = 0;
+        while (block < blocks_)
+        {
+            const int *keys = key_ + block * BLOCK;
+            int i = rank(keys, key);
+            if (i < BLOCK && (keys[i] != INT_MAX || has_max_))
+            {
+                result = keys[i];
+                found = true;
+            }
+            block = block * (BLOCK + 1) + i + 1;
+        }
+        return found;
+    }
+
+    bool FrozenTree::find(int key) const
+    {
+        int result;
+        return lower_bound(key, result) && result == key;
+    }
+
+    int FrozenTree::size() const
+    {
+        return size_;
+    }
+
+    /** Bytes held by the layout
+      */
+    size_t FrozenTree::memory() const
+    {
+        return sizeof(*this) + static_cast<size_t>(blocks_) * BLOCK * sizeof(int);
+    }
+} // namespace Tree
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Read-only, pointer-free copy of a tree (S-tree layout).
+      *
+      * Keys are stored in blocks of BLOCK keys, one or two cache lines
+      * each. Block k has BLOCK + 1 implicit children, the i-th one being
+      * block k * (BLOCK + 1) + i + 1, so a lookup computes every child
+      * position instead of loading a pointer. Blocks are searched with
+      * SIMD compares where the target supports them.
+      */
+    class FrozenTree
+    {
+    public:
+        static const int BLOCK = 16;
+
+        FrozenTree(Node *root);
+        ~FrozenTree();
+        FrozenTree(const FrozenTree &) = delete;
+        FrozenTree &operator=(const FrozenTree &) = delete;
+
+        bool find(int key) const;
+        bool lower_bound(int key, int &result) const;
+        int size() const;
+        size_t memory() const;
+
+    private:
+        static int rank(const int *block, int key);
+        void fill(int block, const int *sorted, int &next);
+
+        int *key_;
+        int blocks_;
+        int size_;
+        bool has_max_;
+    };
+} // namespace Tree
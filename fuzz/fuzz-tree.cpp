@@ -0,0 +1,227 @@
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../node.h"
+#include "../b-plus-tree.h"
+#include "../epoch.h"
+#include "../split-join.h"
+#include "../upsert.h"
+#include "../filter.h"
+
+using namespace std;
+
+namespace
+{
+    const unsigned int CAPACITIES[] = {3, 4, 5, 8, 15, 16, 31, 32, 64, 128};
+    const unsigned int OP_BYTES = 3;
+
+    void fail(const char *what, int key)
+    {
+        printf("fuzz-tree: %s differs from std::set at key %d\n", what, key);
+        abort();
+    }
+
+    /** Key of an operation: mostly a small range, so keys collide and
+      * nodes split and merge, sometimes the ends of int, where a
+      * separator bound can overflow.
+      */
+    int key_of(const uint8_t *op)
+    {
+        int key = (op[1] << 8 | op[2]) % 2048 - 1024;
+        if ((op[0] & 0xc0) == 0xc0)
+        {
+            return op[0] & 0x20 ? INT_MAX - (key & 3) : INT_MIN + (key & 3);
+        }
+        return key;
+    }
+
+    vector<int> expected(const set<int> &keys, int lo, int hi)
+    {
+        if (lo > hi)
+        {
+            return vector<int>();
+        }
+        return vector<int>(keys.lower_bound(lo), keys.upper_bound(hi));
+    }
+
+    /** ************************************************************
+    INPUT       : fuzz input
+    OPERATION   : The first byte picks the capacity and whether inserts,
+    deletes, finds and scans go through a KeyFilter, every
+    following three bytes an operation and its key. Each
+    operation runs on a tree and on a std::set; any
+    difference, a tree validate() rejects, or a filter that
+    rules out a key of the tree, aborts.
+    ************************************************************* */
+    void run(const uint8_t *data, size_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+        unsigned int capacity = CAPACITIES[data[0] % (sizeof(CAPACITIES) / sizeof(CAPACITIES[0]))];
+        bool filtered = data[0] / 10 % 2 == 1;
+        KeyFilter filter(4096);
+        Node *root = new Node(capacity);
+        set<int> keys;
+
+        for (size_t at = 1; at + OP_BYTES <= size; at += OP_BYTES)
+        {
+            const uint8_t *op = data + at;
+            int key = key_of(op);
+            int span = op[0] & 0x3f;
+            int hi = key > INT_MAX - span ? INT_MAX : key + span;
+            switch (filtered ? op[0] % 10 + 10 : op[0] % 10)
+            {
+            case 10:
+            case 11:
+            case 12:
+                if (insert_filtered(root, filter, key) != keys.insert(key).second)
+                {
+                    fail("insert_filtered", key);
+                }
+                break;
+            case 13:
+            case 14:
+            case 18:
+                root = delete_filtered(root, filter, key);
+                keys.erase(key);
+                break;
+            case 15:
+                if (find_filtered(root, filter, key) != (keys.count(key) > 0))
+                {
+                    fail("find_filtered", key);
+                }
+                break;
+            case 16:
+            case 17:
+                if (range_scan_filtered(root, filter, key, hi) != expected(keys, key, hi))
+                {
+                    fail("range_scan_filtered", key);
+                }
+                break;
+            case 0:
+            case 1:
+                if (try_insert(root, key) != keys.insert(key).second)
+                {
+                    fail("try_insert", key);
+                }
+                break;
+            case 2:
+                if (insert_or_assign(root, key) != keys.insert(key).second)
+                {
+                    fail("insert_or_assign", key);
+                }
+                break;
+            case 3:
+                if (keys.erase(key) > 0)
+                { // an absent key makes delete_node() complain
+                    root = delete_node(root, key);
+                }
+                break;
+            case 4:
+                if (erase_if(root, key, nullptr, nullptr) != (keys.erase(key) > 0))
+                {
+                    fail("erase_if", key);
+                }
+                break;
+            case 5:
+                if (find_node(root, key) != (keys.count(key) > 0))
+                {
+                    fail("find_node", key);
+                }
+                break;
+            case 6:
+                if (range_scan(root, key, hi) != expected(keys, key, hi))
+                {
+                    fail("range_scan", key);
+                }
+                break;
+            case 7:
+            {
+                vector<int> want = expected(keys, key, hi);
+                if (reverse_scan(root, hi, key) != vector<int>(want.rbegin(), want.rend()))
+                {
+                    fail("reverse_scan", key);
+                }
+                break;
+            }
+            case 8:
+                root = erase_range(root, key, hi);
+                keys.erase(keys.lower_bound(key), keys.upper_bound(hi));
+                break;
+            case 9:
+            case 19:
+            {
+                Node *right = split_at(root, key);
+                if (!validate(root) || !validate(right) || range_scan(right, INT_MIN, INT_MAX) != expected(keys, key, INT_MAX))
+                {
+                    fail("split_at", key);
+                }
+                root = join(root, right);
+                break;
+            }
+            }
+            if (!validate(root))
+            {
+                fail("validate", key);
+            }
+        }
+
+        if (range_scan(root, INT_MIN, INT_MAX) != vector<int>(keys.begin(), keys.end()))
+        {
+            fail("full scan", 0);
+        }
+        for (set<int>::iterator k = keys.begin(); filtered && k != keys.end(); ++k)
+        {
+            if (!filter.may_contain(*k))
+            {
+                fail("filter", *k);
+            }
+        }
+        write_begin(root);
+        free_subtree(root);
+        write_end(root);
+    }
+} // namespace
+
+/** Entry point for libFuzzer, see README
+  */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    run(data, size);
+    return 0;
+}
+
+#ifndef BPT_LIBFUZZER
+/** ************************************************************
+INPUT       : number of inputs, first seed, both optional
+OPERATION   : Run random inputs of up to 4K operations through the
+same checks as the libFuzzer entry point.
+@return 0, a difference aborts.
+************************************************************* */
+int main(int argc, char **argv)
+{
+    long rounds = argc > 1 ? atol(argv[1]) : 1000;
+    unsigned int seed = argc > 2 ? static_cast<unsigned int>(atol(argv[2])) : 1;
+    mt19937 random(seed);
+    vector<uint8_t> data;
+    for (long r = 0; r < rounds; r++)
+    {
+        data.resize(1 + OP_BYTES * (random() % 4096));
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            data[i] = static_cast<uint8_t>(random());
+        }
+        run(data.data(), data.size());
+    }
+    printf("fuzz-tree: %ld inputs from seed %u agree with std::set\n", rounds, seed);
+    return 0;
+}
+#endif
@@ -0,0 +1,230 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "huge-pages.h"
+
+using namespace std;
+
+namespace Tree
+{
+    namespace
+    {
+        mutex huge_mutex;
+        unordered_map<size_t, vector<void *>> huge_free_list; // by size class
+        char *huge_current = nullptr;                         // region being carved
+        size_t huge_used = 0;                                 // bytes carved from it
+        size_t huge_mapped = 0;
+
+        const int MPOL_BIND_MODE = 2; // MPOL_BIND of <numaif.h>
+
+        size_t round_up(size_t bytes, size_t unit)
+        {
+            return (bytes + unit - 1) / unit * unit;
+        }
+
+        /** Bind a fresh mapping to numa_node, before its pages are touched.
+          * Failure leaves the pages to the default first-touch placement.
+          */
+        void bind_region(void *region, size_t bytes, int numa_node)
+        {
+#if defined(__linux__) && defined(SYS_mbind)
+            if (numa_node < 0 || numa_node >= 64)
+            {
+                return;
+            }
+            unsigned long mask = 1ul << numa_node;
+            syscall(SYS_mbind, region, bytes, MPOL_BIND_MODE, &mask, 64ul, 0u);
+#else
+            (void)region;
+            (void)bytes;
+            (void)numa_node;
+#endif
+        }
+    } // namespace
+
+    /** ************************************************************
+    INPUT       : size in bytes, NUMA node to bind to, -1 for none
+    OPERATION   : Map bytes rounded up to whole huge pages, from the
+    reserved huge page pool if there is one, otherwise as
+    an aligned anonymous mapping advised for transparent
+    huge pages.
+    @return 2MB-aligned, zeroed region, release it with
+    huge_region_free(region, bytes).
+    ************************************************************* */
+    void *huge_region(size_t bytes, int numa_node)
+    {
+        bytes = round_up(bytes > 0 ? bytes : 1, HUGE_PAGE);
+#ifdef __linux__
+        void *region = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (region == MAP_FAILED)
+        { // no reserved huge pages, over-map and trim to alignment
+            char *raw = static_cast<char *>(mmap(nullptr, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (raw == MAP_FAILED)
+            {
+                throw bad_alloc();
+            }
+            char *aligned = reinterpret_cast<char *>(round_up(reinterpret_cast<size_t>(raw), HUGE_PAGE));
+            if (aligned > raw)
+            {
+                munmap(raw, aligned - raw);
+            }
+            munmap(aligned + bytes, raw + HUGE_PAGE - aligned);
+            region = aligned;
+#ifdef MADV_HUGEPAGE
+            madvise(region, bytes, MADV_HUGEPAGE);
+#endif
+        }
+        bind_region(region, bytes, numa_node);
+        return region;
+#else
+        (void)numa_node;
+        void *region = aligned_alloc(HUGE_PAGE, bytes);
+        if (region == nullptr)
+        {
+            throw bad_alloc();
+        }
+        return memset(region, 0, bytes);
+#endif
+    }
+
+    void huge_region_free(void *region, size_t bytes)
+    {
+        if (region == nullptr)
+        {
+            return;
+        }
+#ifdef __linux__
+        munmap(region, round_up(bytes > 0 ? bytes : 1, HUGE_PAGE));
+#else
+        (void)bytes;
+        free(region);
+#endif
+    }
+
+    /** ************************************************************
+    INPUT       : block size in bytes
+    OPERATION   : Round the size up to its class and take a freed block
+    of that class, or carve the next one from the current
+    region, mapping a new region when it is exhausted.
+    Blocks over a quarter region get a region of their own.
+    @return memory for the block, release it with
+    huge_free(block, size).
+    ************************************************************* */
+    void *huge_allocate(size_t size)
+    {
+        size = huge_block(size);
+        if (size > HUGE_PAGE / 4)
+        {
+            void *region = huge_region(size);
+            lock_guard<mutex> lock(huge_mutex);
+            huge_mapped += round_up(size, HUGE_PAGE);
+            return region;
+        }
+        lock_guard<mutex> lock(huge_mutex);
+        vector<void *> &list = huge_free_list[size];
+        if (!list.empty())
+        {
+            void *block = list.back();
+            list.pop_back();
+            return block;
+        }
+        if (huge_current == nullptr || huge_used + size > HUGE_PAGE)
+        { // the tail of the old region is left unused
+            huge_current = static_cast<char *>(huge_region(HUGE_PAGE));
+            huge_used = 0;
+            huge_mapped += HUGE_PAGE;
+        }
+        void *block = huge_current + huge_used;
+        huge_used += size;
+        return block;
+    }
+
+    /** Give a block back to the free list of its class
+      */
+    void huge_free(void *block, size_t size)
+    {
+        if (block == nullptr)
+        {
+            return;
+        }
+        size = huge_block(size);
+        lock_guard<mutex> lock(huge_mutex);
+        if (size > HUGE_PAGE / 4)
+        {
+            huge_region_free(block, size);
+            huge_mapped -= round_up(size, HUGE_PAGE);
+            return;
+        }
+        huge_free_list[size].push_back(block);
+    }
+
+    /** Bytes really taken by a block of size bytes
+      */
+    size_t huge_block(size_t size)
+    {
+        return round_up(size > 0 ? size : 1, HUGE_GRAIN);
+    }
+
+    /** Bytes mapped for blocks, free or not
+      */
+    size_t huge_reserved()
+    {
+        lock_guard<mutex> lock(huge_mutex);
+        return huge_mapped;
+    }
+
+    /** Number of NUMA nodes of this machine, 1 where unknown
+      */
+    int numa_nodes()
+    {
+        int nodes = 1;
+#ifdef __linux__
+        FILE *file = fopen("/sys/devices/system/node/possible", "r");
+        if (file != nullptr)
+        { // "0" or a list like "0-3", the last node is the highest
+            int first = 0;
+            int last = 0;
+            int read = fscanf(file, "%d-%d", &first, &last);
+            if (read == 1)
+            {
+                last = first;
+            }
+            if (read >= 1 && last >= 0)
+            {
+                nodes = last + 1;
+            }
+            fclose(file);
+        }
+#endif
+        return nodes;
+    }
+
+    /** NUMA node the calling thread is running on, 0 where unknown
+      */
+    int numa_node()
+    {
+#if defined(__linux__) && defined(SYS_getcpu)
+        unsigned int cpu = 0;
+        unsigned int node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        {
+            return static_cast<int>(node);
+        }
+#endif
+        return 0;
+    }
+} // namespace Tree
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+namespace Tree
+{
+    /** Memory backed by 2MB huge pages.
+      *
+      * Regions are mapped with MAP_HUGETLB where huge pages are
+      * reserved, otherwise mapped 2MB-aligned and handed to transparent
+      * huge pages with madvise, and can be bound to one NUMA node.
+      * Small blocks are carved from the current region by size class and
+      * recycled through per-class free lists, so the nodes of a tree and
+      * their key and child arrays share a few TLB entries instead of
+      * being scattered over the heap. Carved regions are never returned.
+      * With BPT_HUGE_PAGES every node allocation goes through here.
+      */
+    const size_t HUGE_PAGE = static_cast<size_t>(2) << 20;
+    const size_t HUGE_GRAIN = 16; // size classes are multiples of this
+
+    void *huge_region(size_t bytes, int numa_node = -1);
+    void huge_region_free(void *region, size_t bytes);
+
+    void *huge_allocate(size_t size);
+    void huge_free(void *block, size_t size);
+    size_t huge_block(size_t size);
+    size_t huge_reserved();
+
+    int numa_nodes();
+    int numa_node();
+} // namespace Tree
@@ -0,0 +1,109 @@
+#include "node.h"
+#include "b-plus-tree.h"
+#include "iterator.h"
+
+using namespace std;
+
+namespace Tree
+{
+    /** The end iterator
+      */
+    KeyIterator::KeyIterator()
+        : leaf_(nullptr), index_(0)
+    {
+    }
+
+    KeyIterator::KeyIterator(Node *leaf, int index)
+        : leaf_(leaf), index_(index)
+    {
+    }
+
+    bool KeyIterator::valid() const
+    {
+        return leaf_ != nullptr;
+    }
+
+    /** @return key at the current position, the iterator must be valid.
+      */
+    int KeyIterator::operator*() const
+    {
+        return leaf_->get_key(index_);
+    }
+
+    /** Step to the next larger key, skipping empty leaves
+      */
+    KeyIterator &KeyIterator::operator++()
+    {
+        index_++;
+        while (leaf_ != nullptr && index_ >= leaf_->get_keysize())
+        {
+            leaf_ = leaf_->get_next();
+            index_ = 0;
+        }
+        return *this;
+    }
+
+    /** Step to the next smaller key, skipping empty leaves
+      */
+    KeyIterator &KeyIterator::operator--()
+    {
+        index_--;
+        while (leaf_ != nullptr && index_ < 0)
+        {
+            leaf_ = leaf_->get_prev();
+            index_ = leaf_ != nullptr ? leaf_->get_keysize() - 1 : 0;
+        }
+        return *this;
+    }
+
+    bool KeyIterator::operator==(const KeyIterator &other) const
+    {
+        return leaf_ == other.leaf_ && (leaf_ == nullptr || index_ == other.index_);
+    }
+
+    bool KeyIterator::operator!=(const KeyIterator &other) const
+    {
+        return !(*this == other);
+    }
+} // namespace Tree
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key
+OPERATION   : Seek the leaf of key and the first key not below it.
+@return iterator at the smallest key >= key, the end
+iterator if there is none.
+************************************************************* */
+KeyIterator seek(Node *node, int key)
+{
+    Node *leaf = find_leaf(node, key);
+    int i = 0;
+    while (i < leaf->get_keysize() && leaf->get_key(i) < key)
+    {
+        i++;
+    }
+    KeyIterator it(leaf, i - 1);
+    return ++it;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key
+OPERATION   : Seek the leaf of key, step right once if key sits on
+a separator, and find the last key not above it.
+@return iterator at the largest key <= key, the end
+iterator if there is none. Walk it with --.
+************************************************************* */
+KeyIterator seek_reverse(Node *node, int key)
+{
+    Node *leaf = find_leaf(node, key);
+    while (leaf->get_next() != nullptr && !leaf->get_next()->isEmpty() && leaf->get_next()->get_key(0) <= key)
+    {
+        leaf = leaf->get_next();
+    }
+    int i = leaf->get_keysize();
+    while (i > 0 && leaf->get_key(i - 1) > key)
+    {
+        i--;
+    }
+    KeyIterator it(leaf, i);
+    return --it;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "node.h"
+
+namespace Tree
+{
+    /** Position of one key in the leaf chain.
+      *
+      * ++ moves to the next larger key along the next links, -- to the
+      * next smaller one along the backward links, so a descending walk
+      * costs one seek and then O(1) per key. Stepping past either end
+      * gives the end iterator, which is not valid(). Like the leaf chain
+      * itself, an iterator is invalidated by any write to the tree.
+      */
+    class KeyIterator
+    {
+    public:
+        KeyIterator();
+        KeyIterator(Node *leaf, int index);
+
+        bool valid() const;
+        int operator*() const;
+        KeyIterator &operator++();
+        KeyIterator &operator--();
+        bool operator==(const KeyIterator &other) const;
+        bool operator!=(const KeyIterator &other) const;
+
+    private:
+        Node *leaf_;
+        int index_;
+    };
+} // namespace Tree
+
+using namespace Tree;
+
+KeyIterator seek(Node* node, int key);
+
+KeyIterator seek_reverse(Node* node, int key);
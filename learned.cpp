@@ -0,0 +1,168 @@
+#include <algorithm>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "epoch.h"
+#include "learned.h"
+
+using namespace std;
+
+namespace Tree
+{
+    /** Collect the leaf layer of root and fit the model over it.
+      * error is the largest distance, in leaves, between a predicted
+      * and the actual position. The low key of every leaf is kept in
+      * a flat array, which is what the prediction gets corrected against.
+      */
+    LeafModel::LeafModel(Node *root, int error)
+        : root_(root), error_(error < 1 ? 1 : error), version_(read_begin(root))
+    {
+        for (Node *leaf = get_leftmost_leaf(root); leaf != NULL; leaf = leaf->get_next())
+        {
+            if (!leaf->isEmpty())
+            {
+                leaf_.push_back(leaf);
+                low_.push_back(leaf->get_key(0));
+            }
+        }
+        fit();
+    }
+
+    /** ************************************************************
+    OPERATION   : Greedy shrinking cone. A segment starts at a leaf and
+    keeps the range of slopes for which every following leaf
+    is predicted within error; once the range becomes empty
+    the segment is closed and a new one starts there.
+    ************************************************************* */
+    void LeafModel::fit()
+    {
+        int count = low_.size();
+        int start = 0;
+        while (start < count)
+        {
+            double lo = 0.0;
+            double hi = 1e300;
+            int end = start + 1;
+            for (; end < count; end++)
+            {
+                double dx = static_cast<double>(low_[end]) - low_[start];
+                double dy = end - start;
+                double new_lo = max(lo, (dy - error_) / dx);
+                double new_hi = min(hi, (dy + error_) / dx);
+                if (new_lo > new_hi)
+                {
+                    break;
+                }
+                lo = new_lo;
+                hi = new_hi;
+            }
+            Segment segment;
+            segment.first_key = low_[start];
+            segment.slope = end - start > 1 ? (lo + hi) / 2 : 0.0;
+            segment.first_leaf = start;
+            segment_.push_back(segment);
+            start = end;
+        }
+    }
+
+    /** Predicted leaf index of key, not yet corrected
+      */
+    int LeafModel::predict(int key)
+    {
+        int lo = 0;
+        int hi = segment_.size();
+        while (hi - lo > 1)
+        { // last segment starting at or before key
+            int mid = (lo + hi) / 2;
+            if (segment_[mid].first_key <= key)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        const Segment &segment = segment_[lo];
+        double offset = segment.slope * (static_cast<double>(key) - segment.first_key);
+        if (offset < 0)
+        {
+            offset = 0;
+        }
+        long long position = segment.first_leaf + static_cast<long long>(offset);
+        return position < static_cast<long long>(leaf_.size()) ? position : leaf_.size() - 1;
+    }
+
+    /** ************************************************************
+    INPUT       : integer key
+    OPERATION   : Predict the leaf and correct the guess by a binary
+    search over the leaf low keys within error + 1 leaves of
+    it. Only the leaf that is returned gets touched.
+    @return leaf that would hold key, nullptr if the model is stale.
+    ************************************************************* */
+    Node *LeafModel::find_leaf(int key)
+    {
+        if (!is_fresh())
+        {
+            return nullptr;
+        }
+        if (leaf_.empty())
+        {
+            return root_;
+        }
+        int position = predict(key);
+        int lo = max(position - error_ - 1, 0);
+        int hi = min(position + error_ + 2, static_cast<int>(low_.size()));
+        if (low_[lo] > key)
+        { // only reached for keys below the first leaf
+            lo = 0;
+        }
+        while (hi - lo > 1)
+        { // last leaf starting at or before key
+            int mid = (lo + hi) / 2;
+            if (low_[mid] <= key)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        return leaf_[lo];
+    }
+
+    /** Look key up through the model, or by a normal descent when
+      * the tree changed after the model was built.
+      */
+    bool LeafModel::find(int key)
+    {
+        Node *leaf = find_leaf(key);
+        if (leaf == nullptr)
+        {
+            return find_node(root_, key);
+        }
+        for (int i = 0; i < leaf->get_keysize(); i++)
+        {
+            if (leaf->get_key(i) == key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Check that the tree was not modified since the model was built.
+      * Trees whose roots share a latch share its version, so a write
+      * to one of those retires the model too.
+      */
+    bool LeafModel::is_fresh()
+    {
+        return read_validate(root_, version_);
+    }
+
+    int LeafModel::segments()
+    {
+        return segment_.size();
+    }
+} // namespace Tree
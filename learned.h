@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Piecewise-linear model from integer keys to leaf positions.
+      *
+      * Built over the leaf layer of a finished tree (typically right after
+      * bulk_build), the model predicts the index of the leaf holding a key
+      * within +-error leaves. The guess is corrected against the low keys
+      * of the leaf chain, so no internal node is touched.
+      * Any later insert or delete makes the model stale, and lookups fall
+      * back to a normal descent until it is rebuilt.
+      */
+    class LeafModel
+    {
+    public:
+        LeafModel(Node *root, int error);
+
+        bool find(int key);
+        Node *find_leaf(int key);
+        bool is_fresh();
+        int segments();
+
+    private:
+        struct Segment
+        {
+            int first_key;
+            double slope;
+            int first_leaf;
+        };
+
+        void fit();
+        int predict(int key);
+
+        Node *root_;
+        int error_;
+        unsigned long version_;
+        std::vector<Node *> leaf_;
+        std::vector<int> low_;
+        std::vector<Segment> segment_;
+    };
+} // namespace Tree
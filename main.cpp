@@ -3,14 +3,76 @@
 
 #include "node.h"
 #include "b-plus-tree.h"
+#include "stats.h"
+#include "replay.h"
+#include "tune.h"
+#include "fixed-capacity.h"
+#include "external-sort.h"
+#include "upsert.h"
 
 using namespace Tree;
 
-int main()
+namespace
+{
+    typedef int (*Command)(int argc, char **argv);
+
+    /** The batch command among the arguments. --replay alone replays
+      * a trace, next to --tune it names the trace to tune with.
+      * @return its entry point, nullptr if there is none.
+      */
+    Command command_of(int argc, char **argv)
+    {
+        Command command = nullptr;
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--tune")
+            {
+                return tune_main;
+            }
+            if (arg == "--kernels")
+            {
+                command = kernels_main;
+            }
+            else if (arg == "--build")
+            {
+                command = build_main;
+            }
+            else if ((arg == "--replay" || arg == "--convert") && command == nullptr)
+            {
+                command = replay_main;
+            }
+        }
+        return command;
+    }
+
+    void usage()
+    {
+        cout << "usage: b-plus-tree --replay <trace | -> [--capacity N] [--validate]" << endl
+             << "       b-plus-tree --convert <trace | -> <binary trace>" << endl
+             << "       b-plus-tree --tune [--replay <trace | ->]" << endl
+             << "       b-plus-tree --kernels" << endl
+             << "       b-plus-tree --build <keys | -> [--capacity N] [--memory MB] [--binary] [--validate]" << endl
+             << "without arguments the interactive menu is started" << endl;
+    }
+} // namespace
+
+int main(int argc, char **argv)
 {
     unsigned int capacity;
     int input;
 
+    if (argc > 1)
+    { // scripted mode
+        Command command = command_of(argc, argv);
+        if (command == nullptr)
+        {
+            usage();
+            return 1;
+        }
+        return command(argc, argv);
+    }
+
     std::cout << "This is B+Tree made by Jaemin Kim" << endl;
 
 start:
@@ -65,7 +127,10 @@ start:
                 cin.clear();
                 continue;
             }
-            insert_node(root, input);
+            if (!try_insert(root, input))
+            {
+                cout << "key already in tree!" << endl;
+            }
             cin.clear();
             break;
 
@@ -93,7 +158,7 @@ start:
             }
             for (int i = begin; i < end; i++)
             {
-                insert_node(root, i);
+                try_insert(root, i); // keys already there are skipped
             }
             break;
 
@@ -112,7 +177,7 @@ start:
             break;
 
         case 3:
-            cout << "0:print leaf / 1:print tree" << endl;
+            cout << "0:print leaf / 1:print tree / 2:validate / 3:stats" << endl;
             cout << "Enter an option: ";
             cin.clear();
 
@@ -131,6 +196,14 @@ start:
             {
                 print_tree(root);
             }
+            else if (input == 2)
+            {
+                cout << (validate(root) ? "tree is valid" : "tree is broken!") << endl;
+            }
+            else if (input == 3)
+            {
+                print_stats(root);
+            }
             else
             {
                 cout << "Not a valid option. try again!" << endl;
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "merge-join.h"
+
+using namespace std;
+
+namespace
+{
+    /** Position in the leaf chain of one tree, walked by the joins
+      * directly over the leaves' key arrays.
+      */
+    struct LeafCursor
+    {
+        Node *root;
+        Node *leaf;
+        const int *keys; // of leaf, cached with its size
+        int size;
+        int index;
+
+        LeafCursor(Node *tree) : root(tree), leaf(nullptr), keys(nullptr), size(0), index(0)
+        {
+            enter(get_leftmost_leaf(tree), 0);
+            skip_empty();
+        }
+
+        void enter(Node *node, int position)
+        {
+            leaf = node;
+            index = position;
+            if (node != nullptr)
+            {
+                keys = node->get_keys();
+                size = node->get_keysize();
+            }
+        }
+
+        bool valid() const
+        {
+            return leaf != nullptr;
+        }
+
+        int key() const
+        {
+            return keys[index];
+        }
+
+        /** Move off the end of a leaf onto the next non-empty one
+          */
+        void skip_empty()
+        {
+            while (leaf != nullptr && index >= size)
+            {
+                enter(leaf->get_next(), 0);
+            }
+        }
+
+        void next()
+        {
+            if (++index >= size)
+            {
+                skip_empty();
+            }
+        }
+
+        /** Galloping search: probe index + 1, + 2, + 4 ... until a key
+          * >= key, then binary search the last step.
+          * @return index of the first key >= key at or after from.
+          */
+        static int gallop(const int *keys, int size, int from, int key)
+        { // keys[from] < key <= keys[size - 1]
+            int step = 1;
+            int lo = from;
+            while (from + step < size && keys[from + step] < key)
+            {
+                lo = from + step;
+                step *= 2;
+            }
+            int hi = min(from + step + 1, size);
+            return lower_bound(keys + lo, keys + hi, key) - keys;
+        }
+
+        /** ************************************************************
+        INPUT       : key to reach, no smaller than the current one
+        OPERATION   : Move to the first key >= key. Gallop when it lies in
+        the current leaf or the next one, otherwise seek it with
+        a lower_bound descent from the root, so skipping over a
+        long run of keys costs O(log n) instead of O(run).
+        ************************************************************* */
+        void advance(int target)
+        {
+            if (keys[size - 1] >= target)
+            {
+                index = gallop(keys, size, index, target);
+                return;
+            }
+            Node *next = leaf->get_next();
+            if (next != nullptr && !next->isEmpty() && next->get_keys()[next->get_keysize() - 1] >= target)
+            { // one hop along the chain
+                enter(next, 0);
+                index = keys[0] >= target ? 0 : gallop(keys, size, 0, target);
+                return;
+            }
+            enter(find_leaf(root, target), 0);
+            index = lower_bound(keys, keys + size, target) - keys;
+            skip_empty(); // a key equal to a separator lives right of it
+        }
+    };
+
+    void collect_key(int key, void *context)
+    {
+        static_cast<vector<int> *>(context)->push_back(key);
+    }
+} // namespace
+
+/** ************************************************************
+INPUT       : Root node pointers of two trees, visitor, its context
+OPERATION   : Leapfrog join: walk both leaf chains in lockstep and,
+whenever one side is behind, advance it to the other
+side's key, galloping or seeking past keys without a
+match. Dense inputs run as a plain merge, sparse ones in
+O(m log n) for m keys on the sparse side.
+@return number of keys found in both trees.
+************************************************************* */
+unsigned long merge_join(Node *left, Node *right, JoinVisitor visit, void *context)
+{
+    unsigned long matches = 0;
+    LeafCursor a(left);
+    LeafCursor b(right);
+    while (a.valid() && b.valid())
+    {
+        int x = a.key();
+        int y = b.key();
+        if (x == y)
+        {
+            visit(x, context);
+            matches++;
+            a.next();
+            b.next();
+        }
+        else if (x < y)
+        {
+            a.advance(y);
+        }
+        else
+        {
+            b.advance(x);
+        }
+    }
+    return matches;
+}
+
+/** ************************************************************
+INPUT       : Root node pointers of two trees
+OPERATION   : merge_join() collecting the matches.
+@return keys found in both trees in ascending order.
+************************************************************* */
+vector<int> intersect_trees(Node *left, Node *right)
+{
+    vector<int> keys;
+    merge_join(left, right, collect_key, &keys);
+    return keys;
+}
+
+/** ************************************************************
+INPUT       : Root node pointers of two trees
+OPERATION   : Merge both leaf chains. Each side's run of keys below
+the other side's current key is copied from its leaf as
+a block, so disjoint ranges cost one search per leaf.
+@return keys found in either tree in ascending order,
+each once.
+************************************************************* */
+vector<int> union_trees(Node *left, Node *right)
+{
+    vector<int> keys;
+    LeafCursor a(left);
+    LeafCursor b(right);
+    while (a.valid() && b.valid())
+    {
+        int x = a.key();
+        int y = b.key();
+        if (x == y)
+        {
+            keys.push_back(x);
+            a.next();
+            b.next();
+            continue;
+        }
+        LeafCursor &low = x < y ? a : b;
+        int bound = x < y ? y : x;
+        int end = lower_bound(low.keys + low.index, low.keys + low.size, bound) - low.keys;
+        keys.insert(keys.end(), low.keys + low.index, low.keys + end);
+        low.index = end;
+        low.skip_empty();
+    }
+    for (LeafCursor *rest : {&a, &b})
+    {
+        while (rest->valid())
+        {
+            keys.insert(keys.end(), rest->keys + rest->index, rest->keys + rest->size);
+            rest->index = rest->size;
+            rest->skip_empty();
+        }
+    }
+    return keys;
+}
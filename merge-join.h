@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Called by merge_join() for every key found in both trees,
+      * in ascending order.
+      */
+    typedef void (*JoinVisitor)(int key, void *context);
+} // namespace Tree
+
+using namespace Tree;
+
+unsigned long merge_join(Node* left, Node* right, JoinVisitor visit, void* context);
+
+vector<int> intersect_trees(Node* left, Node* right);
+
+vector<int> union_trees(Node* left, Node* right);
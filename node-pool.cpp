@@ -0,0 +1,101 @@
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "node.h"
+
+#ifdef BPT_COMPACT_HANDLES
+using namespace std;
+
+namespace Tree
+{
+    char *pool_chunk[POOL_CHUNKS];
+
+    namespace
+    {
+        mutex pool_mutex;
+        vector<NodeHandle> pool_free_list;
+        NodeHandle pool_next = 1; // next never used handle
+        size_t pool_in_use = 0;
+    } // namespace
+
+    /** ************************************************************
+    INPUT       : object size, must be sizeof(Node)
+    OPERATION   : Take a freed slot, or the next unused one, adding a
+    chunk when the last one is exhausted, and stamp the
+    slot's handle into its header.
+    @return memory for one node.
+    ************************************************************* */
+    void *pool_allocate(size_t size)
+    {
+        if (size + POOL_HEADER > POOL_SLOT)
+        {
+            throw bad_alloc();
+        }
+        lock_guard<mutex> lock(pool_mutex);
+        NodeHandle handle;
+        if (!pool_free_list.empty())
+        {
+            handle = pool_free_list.back();
+            pool_free_list.pop_back();
+        }
+        else
+        {
+            if (pool_next == 0)
+            { // all 2^32 - 1 handles in use
+                throw bad_alloc();
+            }
+            handle = pool_next++;
+            unsigned int chunk = (handle - 1) >> POOL_CHUNK_BITS;
+            if (pool_chunk[chunk] == nullptr)
+            {
+#ifdef BPT_HUGE_PAGES
+                pool_chunk[chunk] = static_cast<char *>(huge_allocate(POOL_CHUNK * POOL_SLOT));
+#else
+                pool_chunk[chunk] = static_cast<char *>(malloc(POOL_CHUNK * POOL_SLOT));
+#endif
+                if (pool_chunk[chunk] == nullptr)
+                {
+                    pool_next--;
+                    throw bad_alloc();
+                }
+            }
+        }
+        pool_in_use++;
+        char *slot = reinterpret_cast<char *>(pool_node(handle)) - POOL_HEADER;
+        *reinterpret_cast<NodeHandle *>(slot) = handle;
+        return slot + POOL_HEADER;
+    }
+
+    /** Give a node's slot back for reuse. Chunks stay allocated.
+      */
+    void pool_free(void *node)
+    {
+        if (node == nullptr)
+        {
+            return;
+        }
+        lock_guard<mutex> lock(pool_mutex);
+        pool_free_list.push_back(pool_handle(static_cast<Node *>(node)));
+        pool_in_use--;
+    }
+
+    /** Number of nodes currently allocated
+      */
+    size_t pool_live()
+    {
+        lock_guard<mutex> lock(pool_mutex);
+        return pool_in_use;
+    }
+
+    /** Bytes taken by the chunks
+      */
+    size_t pool_reserved()
+    {
+        lock_guard<mutex> lock(pool_mutex);
+        size_t chunks = (pool_next - 1 + POOL_CHUNK - 1) / POOL_CHUNK;
+        return chunks * POOL_CHUNK * POOL_SLOT;
+    }
+} // namespace Tree
+#endif
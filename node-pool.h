@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace Tree
+{
+    class Node;
+    typedef uint32_t NodeHandle;
+
+    /** Node pool behind BPT_COMPACT_HANDLES.
+      *
+      * Nodes are carved from chunks of POOL_CHUNK slots that are never
+      * moved or returned, so handle h (0 meaning none) names slot h - 1
+      * for the whole run. Each slot starts with a small header holding
+      * its own handle, which makes the pointer to handle step a single
+      * load. Handles stay valid when the chunks are copied or mapped
+      * elsewhere, so the pool can be snapshotted or relocated without
+      * rewriting any child array.
+      * Included at the end of node.h, where Node is complete.
+      */
+    const unsigned int POOL_CHUNK_BITS = 12;
+    const unsigned int POOL_CHUNK = 1u << POOL_CHUNK_BITS;
+    const unsigned int POOL_CHUNKS = 1u << (32 - POOL_CHUNK_BITS);
+    const size_t POOL_HEADER = 8;
+    const size_t POOL_SLOT = POOL_HEADER + (sizeof(Node) + 7) / 8 * 8;
+
+    extern char *pool_chunk[POOL_CHUNKS];
+
+    void *pool_allocate(size_t size);
+    void pool_free(void *node);
+    size_t pool_live();
+    size_t pool_reserved();
+
+    /** Handle of a pool node, 0 for nullptr
+      */
+    inline NodeHandle pool_handle(const Node *node)
+    {
+        if (node == nullptr)
+        {
+            return 0;
+        }
+        return *reinterpret_cast<const NodeHandle *>(reinterpret_cast<const char *>(node) - POOL_HEADER);
+    }
+
+    /** Node named by a handle, nullptr for 0
+      */
+    inline Node *pool_node(NodeHandle handle)
+    {
+        if (handle == 0)
+        {
+            return nullptr;
+        }
+        NodeHandle index = handle - 1;
+        char *slot = pool_chunk[index >> POOL_CHUNK_BITS] + (index & (POOL_CHUNK - 1)) * POOL_SLOT;
+        return reinterpret_cast<Node *>(slot + POOL_HEADER);
+    }
+} // namespace Tree
@@ -1,20 +1,130 @@
+#include <climits>
 #include <iostream>
+#include <new>
 #include <vector>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #include "node.h"
+#include "fixed-capacity.h"
+
+namespace Tree
+{
+    /** Augmentation of an internal node, see aggregate.h, allocated
+      * in one block with the capacity + 1 child aggregates behind it.
+      */
+    struct Augment
+    {
+        const Monoid *monoid;
+        long long *aggregate; // monoid of each child's subtree
+    };
+} // namespace Tree
 
 using namespace std;
 
+namespace
+{
+    /** Bytes the heap really spends on a block of requested bytes
+      */
+    size_t heap_block(const void *block, size_t requested)
+    {
+        if (block == nullptr)
+        {
+            return 0;
+        }
+#ifdef __GLIBC__
+        (void)requested;
+        return malloc_usable_size(const_cast<void *>(block)) + sizeof(size_t); // plus the chunk header
+#else
+        return (requested + sizeof(size_t) + 15) / 16 * 16;
+#endif
+    }
+
+    /** Bytes really spent on a key list or child array block
+      */
+    size_t node_block(const void *block, size_t requested)
+    {
+#ifdef BPT_HUGE_PAGES
+        return block != nullptr ? Tree::huge_block(requested) : 0;
+#else
+        return heap_block(block, requested);
+#endif
+    }
+
+    size_t augment_bytes(unsigned int capacity)
+    {
+        return sizeof(Tree::Augment) + (capacity + 1) * sizeof(long long);
+    }
+
+    /** Key and child slots come from huge pages with the nodes
+      */
+    template <typename T>
+    T *allocate_slots(unsigned int count)
+    {
+#ifdef BPT_HUGE_PAGES
+        return static_cast<T *>(Tree::huge_allocate(count * sizeof(T)));
+#else
+        return new T[count];
+#endif
+    }
+
+    template <typename T>
+    void free_slots(T *slots, unsigned int count)
+    {
+#ifdef BPT_HUGE_PAGES
+        Tree::huge_free(slots, count * sizeof(T));
+#else
+        (void)count;
+        delete[] slots;
+#endif
+    }
+
+    /** Every field an optimistic reader may look at concurrently with
+      * the writer, the keys, their number, the child slots and the
+      * type, is written with relaxed atomic stores and read back with
+      * relaxed atomic loads, so a torn read is a stale value that
+      * read_validate() rejects, never a data race. Child slots publish
+      * with release and are read with acquire, so a reader that follows
+      * one to a node just created by a split sees it initialized. The
+      * writer's own reads need no atomics, no one else writes.
+      */
+    template <typename T>
+    void store_slot(T *slot, T value, int order = __ATOMIC_RELAXED)
+    {
+        __atomic_store(slot, &value, order);
+    }
+
+    template <typename T>
+    T load_slot(const T *slot, int order = __ATOMIC_RELAXED)
+    {
+        T value;
+        __atomic_load(slot, &value, order);
+        return value;
+    }
+} // namespace
+
 namespace Tree
 {
     /** Create an Node.
       */
     Node::Node(unsigned int capacity)
-        : capacity_(capacity), key_({}), type_(TREE_ROOT_LEAF), child_(new Node *[capacity + 1])
+#ifdef BPT_COMPACT_HANDLES
+        : capacity_(capacity), type_(TREE_ROOT_LEAF), size_(0), prev_(0), key_(allocate_slots<int>(capacity + 1)),
+          child_(allocate_slots<NodeHandle>(capacity + 1)), augment_(nullptr)
+#else
+        : capacity_(capacity), type_(TREE_ROOT_LEAF), size_(0), key_(allocate_slots<int>(capacity + 1)),
+          child_(allocate_slots<Node *>(capacity + 1)), prev_(0), augment_(nullptr)
+#endif
     {
+        // a fixed block, so keys never move underneath an optimistic
+        // reader (see snapshot_find); the slots past size_ hold INT_MAX
+        // until used, see rank_fixed
         for (unsigned int i = 0; i < capacity + 1; i++)
         {
-            this->child_[i] = NULL;
+            this->key_[i] = INT_MAX;
+            this->child_[i] = 0;
         }
     }
 
@@ -23,7 +133,9 @@ namespace Tree
       */
     Node::~Node()
     {
-        delete[] child_;
+        set_monoid(nullptr);
+        free_slots(key_, capacity_ + 1);
+        free_slots(child_, capacity_ + 1);
     }
 
     /** Get the branching factor... capacity of the key list
@@ -38,6 +150,15 @@ namespace Tree
       * @return the full list of integer keys as vector
       */
     vector<int> Node::get_keylist()
+    {
+        return vector<int>(key_, key_ + size_);
+    }
+
+    /** Get the key list in place, without copying it
+      * @return pointer to get_keysize() ascending keys, valid until the
+      * node is written to.
+      */
+    const int *Node::get_keys()
     {
         return key_;
     }
@@ -47,7 +168,7 @@ namespace Tree
       */
     int Node::get_key(int index)
     {
-        if (index < key_.size())
+        if (index < size_)
         {
             return key_[index];
         }
@@ -59,7 +180,7 @@ namespace Tree
 
     int Node::get_keysize()
     {
-        return this->key_.size();
+        return this->size_;
     }
 
     /** Add a key to the list with ascending order
@@ -67,79 +188,71 @@ namespace Tree
       */
     int Node::add_key(int key)
     {
-        int size = key_.size();
-        if (size == 0)
-        {
-            this->key_.insert(this->key_.begin(), key);
-            return 0;
-        }
-        else
+        int i = key_rank<true>(key_, size_, capacity_, key);
+        for (int j = size_; j > i; j--)
         {
-            unsigned int i;
-            for (i = 0; i < key_.size(); i++)
-            {
-                if (key < get_keylist()[i])
-                {
-                    this->key_.insert(this->key_.begin() + i, key);
-                    return i;
-                }
-            }
-            this->key_.insert(this->key_.end(), key);
-            return i;
+            store_slot(&key_[j], key_[j - 1]);
         }
+        store_slot(&key_[i], key);
+        store_slot(&size_, size_ + 1);
+        return i;
     }
 
     /** Delete a key from the list with ascending order
       * if key was not found, print "key not in tree"
+      * @return whether the key was found.
       */
-    void Node::del_key(int key)
+    bool Node::del_key(int key)
     {
-        for (unsigned int i = 0; i < key_.size(); i++)
+        int i = key_rank<false>(key_, size_, capacity_, key);
+        if (i < size_ && key_[i] == key)
         {
-            if (key == key_[i])
+            for (int j = i; j < size_ - 1; j++)
             {
-                key_.erase(key_.begin() + i);
-                return;
+                store_slot(&key_[j], key_[j + 1]);
             }
+            store_slot(&size_, size_ - 1);
+            return true;
         }
         cout << "key not in tree!" << endl;
-        return;
+        return false;
+    }
+
+    /** Drop the keys from index size on, e.g. the upper half of a split
+      */
+    void Node::trim_keys(int size)
+    {
+        store_slot(&size_, size);
     }
 
     /** Get a list of Node pointers to its children
       * @return lists of pointers to children.
       */
-    Node **Node::get_child()
+    Children Node::get_child()
     {
-        return child_;
+        return Children(child_);
     }
 
     /** Set a child to the list of children at the specific index
       */
     void Node::set_child(Node *child, int index)
     {
-        this->child_[index] = child;
+#ifdef BPT_COMPACT_HANDLES
+        store_slot(&child_[index], pool_handle(child), __ATOMIC_RELEASE);
+#else
+        store_slot(&child_[index], child, __ATOMIC_RELEASE);
+#endif
     }
 
     /** Delete a child from the list of children at the specific index
       */
     void Node::del_child(int index)
     {
-        for (unsigned int i = index; i < key_.size(); i++)
+        for (int i = index; i < size_; i++)
         {
-            this->child_[index] = this->child_[index + 1];
+            store_slot(&child_[i], child_[i + 1], __ATOMIC_RELEASE);
         }
-        this->child_[key_.size()] = NULL;
-    }
-
-    /** Copy contents from other node, without copying the actual address
-      */
-    void Node::copy_child(Node *node)
-    {
-        this->capacity_ = node->get_capacity();
-        this->key_ = node->get_keylist();
-        this->type_ = node->get_type();
-        this->child_ = node->get_child();
+        set_child(nullptr, size_);
     }
 
     /** Get a pointer to the neighbor node
@@ -147,14 +260,41 @@ namespace Tree
       */
     Node *Node::get_next()
     {
+#ifdef BPT_COMPACT_HANDLES
+        return pool_node(child_[capacity_]);
+#else
         return child_[capacity_];
+#endif
     }
 
     /** Set input node as next node
       */
     void Node::set_next(Node *node)
     {
-        this->child_[capacity_] = node;
+        set_child(node, capacity_);
+    }
+
+    /** Get a pointer to the previous leaf
+      * @return pointer to the previous leaf, NULL for the left-most one.
+      */
+    Node *Node::get_prev()
+    {
+#ifdef BPT_COMPACT_HANDLES
+        return pool_node(prev_);
+#else
+        return prev_;
+#endif
+    }
+
+    /** Set input node as previous leaf
+      */
+    void Node::set_prev(Node *node)
+    {
+#ifdef BPT_COMPACT_HANDLES
+        this->prev_ = pool_handle(node);
+#else
+        this->prev_ = node;
+#endif
     }
 
     /** Get the type of current node
@@ -169,7 +309,7 @@ namespace Tree
       */
     void Node::set_type(TreeNodeType type)
     {
-        this->type_ = type;
+        store_slot(&type_, type);
     }
 
     /** Check whether the node is full
@@ -177,7 +317,7 @@ namespace Tree
       */
     bool Node::isFull()
     {
-        if (key_.size() >= capacity_)
+        if (size_ >= static_cast<int>(capacity_))
         {
             return true;
         }
@@ -192,7 +332,7 @@ namespace Tree
       */
     bool Node::isEmpty()
     {
-        if (key_.empty())
+        if (size_ == 0)
         {
             return true;
         }
@@ -201,4 +341,132 @@ namespace Tree
             return false;
         }
     }
+
+    /** Get the monoid the node aggregates its children with
+      * @return the monoid, nullptr if the tree is not augmented.
+      */
+    const Monoid *Node::get_monoid()
+    {
+        return augment_ != nullptr ? augment_->monoid : nullptr;
+    }
+
+    /** Augment the node with monoid, or drop the augmentation for nullptr.
+      * The block for the aggregates is only allocated here, so nodes of
+      * plain trees and leaves carry a null pointer and nothing else.
+      * The aggregates are left to the caller, see refresh_aggregates.
+      */
+    void Node::set_monoid(const Monoid *monoid)
+    {
+        if (monoid == nullptr)
+        {
+            if (augment_ != nullptr)
+            {
+                ::operator delete(augment_);
+                this->augment_ = nullptr;
+            }
+            return;
+        }
+        if (augment_ == nullptr)
+        {
+            void *block = ::operator new(augment_bytes(capacity_));
+            this->augment_ = new (block) Augment;
+            this->augment_->aggregate = reinterpret_cast<long long *>(augment_ + 1);
+        }
+        this->augment_->monoid = monoid;
+    }
+
+    /** Get the aggregate of the child at the specific index
+      * @return monoid of every key below that child.
+      */
+    long long Node::get_aggregate(int index)
+    {
+        return augment_->aggregate[index];
+    }
+
+    void Node::set_aggregate(long long value, int index)
+    {
+        this->augment_->aggregate[index] = value;
+    }
+
+    /** Add the bytes of this node to usage
+      */
+    void Node::add_memory(MemoryUsage &usage)
+    {
+        size_t keys = size_ * sizeof(int);
+        size_t reserved = (capacity_ + 1) * sizeof(int);
+        size_t children = (capacity_ + 1) * sizeof(child_[0]);
+        size_t aggregate = augment_ != nullptr ? augment_bytes(capacity_) : 0;
+
+        usage.nodes++;
+        usage.keys += size_;
+        usage.key_bytes += keys;
+        usage.key_slack += reserved - keys;
+        usage.child_bytes += children;
+        usage.node_bytes += sizeof(Node);
+        usage.aggregate_bytes += aggregate;
+#ifdef BPT_COMPACT_HANDLES
+        usage.allocator_bytes += POOL_SLOT - sizeof(Node);
+#elif defined(BPT_HUGE_PAGES)
+        usage.allocator_bytes += huge_block(sizeof(Node)) - sizeof(Node);
+#else
+        usage.allocator_bytes += heap_block(this, sizeof(Node)) - sizeof(Node);
+#endif
+        usage.allocator_bytes += node_block(key_, reserved) - reserved;
+        usage.allocator_bytes += node_block(child_, children) - children;
+        usage.allocator_bytes += heap_block(augment_, aggregate) - aggregate;
+    }
+
+    /** Number of keys, for a reader outside the writer lock
+      * @return at most capacity, even while a writer changes the node.
+      */
+    int Node::load_keysize()
+    {
+        int size = load_slot(&size_);
+        return size < static_cast<int>(capacity_) ? size : static_cast<int>(capacity_);
+    }
+
+    int Node::load_key(int index)
+    {
+        return load_slot(&key_[index]);
+    }
+
+    Node *Node::load_child(int index)
+    {
+#ifdef BPT_COMPACT_HANDLES
+        return pool_node(load_slot(&child_[index], __ATOMIC_ACQUIRE));
+#else
+        return load_slot(&child_[index], __ATOMIC_ACQUIRE);
+#endif
+    }
+
+    TreeNodeType Node::load_type()
+    {
+        return load_slot(&type_);
+    }
+
+#ifdef BPT_COMPACT_HANDLES
+    /** Nodes are allocated from the node pool, so they have a handle
+      */
+    void *Node::operator new(size_t size)
+    {
+        return pool_allocate(size);
+    }
+
+    void Node::operator delete(void *node)
+    {
+        pool_free(node);
+    }
+#elif defined(BPT_HUGE_PAGES)
+    /** Nodes are carved from huge page regions, see huge-pages.h
+      */
+    void *Node::operator new(size_t size)
+    {
+        return huge_allocate(size);
+    }
+
+    void Node::operator delete(void *node, size_t size)
+    {
+        huge_free(node, size);
+    }
+#endif
 } // namespace Tree
\ No newline at end of file
@@ -1,10 +1,45 @@
 #pragma once
+#include <cstddef>
 #include <vector>
 
+#ifdef BPT_COMPACT_HANDLES
+#include <cstdint>
+#endif
+#ifdef BPT_HUGE_PAGES
+#include "huge-pages.h"
+#endif
+
 using namespace std;
 
 namespace Tree
 {
+    class Node;
+    struct Monoid;
+    struct Augment;
+
+#ifdef BPT_COMPACT_HANDLES
+    /** With BPT_COMPACT_HANDLES nodes live in the node pool and a child
+      * is stored as a 32-bit handle instead of a 64-bit pointer.
+      * get_child() then hands out this view, which resolves handles on
+      * indexing, so callers read children the same way in both modes.
+      */
+    typedef uint32_t NodeHandle;
+
+    class ChildHandles
+    {
+    public:
+        ChildHandles(NodeHandle *handles) : handles_(handles) {}
+        Node *operator[](int index) const;
+
+    private:
+        NodeHandle *handles_;
+    };
+
+    typedef ChildHandles Children;
+#else
+    typedef Node **Children;
+#endif
+
     enum TreeNodeType
     {
         TREE_LEAF,
@@ -13,6 +48,31 @@ namespace Tree
         TREE_ROOT_LEAF
     };
 
+    /** Bytes held by a tree, split by what they are spent on.
+      * Allocator overhead is what the heap (or the node pool) keeps on
+      * top of the requested sizes: headers, rounding and free slack.
+      */
+    struct MemoryUsage
+    {
+        size_t nodes;
+        size_t keys;
+        size_t key_bytes;       // live keys
+        size_t key_slack;       // unused key slots
+        size_t child_bytes;     // child arrays, incl. the leaf next links
+        size_t node_bytes;      // the Node objects themselves
+        size_t buffer_bytes;    // BufferedTree message buffers, see BufferedTree::add_memory
+        size_t aggregate_bytes; // per-child aggregates, see aggregate.h
+        size_t allocator_bytes; // allocator overhead
+
+        MemoryUsage()
+            : nodes(0), keys(0), key_bytes(0), key_slack(0), child_bytes(0),
+              node_bytes(0), buffer_bytes(0), aggregate_bytes(0), allocator_bytes(0) {}
+        size_t total() const
+        {
+            return key_bytes + key_slack + child_bytes + node_bytes + buffer_bytes + aggregate_bytes + allocator_bytes;
+        }
+    };
+
     class Node
     {
     public:
@@ -20,25 +80,66 @@ namespace Tree
         ~Node();
         int get_capacity();
         vector<int> get_keylist();
+        const int *get_keys();
         int get_key(int index);
         int get_keysize();
         int add_key(int key);
-        void del_key(int key);
-        Node **get_child();
+        bool del_key(int key);
+        void trim_keys(int size);
+        Children get_child();
         void set_child(Node *child, int index);
         void del_child(int index);
-        void copy_child(Node *node);
         Node *get_next();
         void set_next(Node *node);
+        Node *get_prev();
+        void set_prev(Node *node);
         TreeNodeType get_type();
         void set_type(TreeNodeType type);
         bool isFull();
         bool isEmpty();
+        const Monoid *get_monoid();
+        void set_monoid(const Monoid *monoid);
+        long long get_aggregate(int index);
+        void set_aggregate(long long value, int index);
+        void add_memory(MemoryUsage &usage);
+
+        // for readers outside the writer lock, see snapshot_find
+        int load_keysize();
+        int load_key(int index);
+        Node *load_child(int index);
+        TreeNodeType load_type();
+
+#if defined(BPT_COMPACT_HANDLES)
+        static void *operator new(size_t size);
+        static void operator delete(void *node);
+#elif defined(BPT_HUGE_PAGES)
+        static void *operator new(size_t size);
+        static void operator delete(void *node, size_t size);
+#endif
 
     private:
         unsigned int capacity_;
-        vector<int> key_;
         TreeNodeType type_;
+        int size_; // number of keys
+#ifdef BPT_COMPACT_HANDLES
+        NodeHandle prev_;
+        int *key_; // capacity + 1 slots, ascending up to size_
+        NodeHandle *child_;
+        Augment *augment_;
+#else
+        int *key_; // capacity + 1 slots, ascending up to size_
         Node **child_;
+        Node *prev_; // previous leaf, the next one is child_[capacity_]
+        Augment *augment_; // monoid and child aggregates, only on augmented internal nodes
+#endif
     };
-} // namespace Tree
\ No newline at end of file
+} // namespace Tree
+
+#ifdef BPT_COMPACT_HANDLES
+#include "node-pool.h"
+
+inline Tree::Node *Tree::ChildHandles::operator[](int index) const
+{
+    return pool_node(handles_[index]);
+}
+#endif
\ No newline at end of file
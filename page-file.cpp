@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <queue>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "node.h"
+#include "page-file.h"
+
+using namespace std;
+
+/*  Page layout, in ints:
+*   header page 0   : magic, page size, root page, page count, capacity
+*   node page       : type (0 leaf, 1 internal), key count, next leaf page
+*                     (0 for none), keys, and for internal nodes the pages
+*                     of the key count + 1 children.
+*/
+namespace
+{
+    const int PAGE_MAGIC = 0x50545042; // "BPTP"
+    const int PAGE_LEAF = 0;
+    const int PAGE_INTERNAL = 1;
+    const int PAGE_KEYS = 3;
+
+    /** Page of the child that holds key
+      */
+    int child_page(const vector<int> &page, int key)
+    {
+        int count = page[1];
+        int i = 0;
+        while (i < count && key >= page[PAGE_KEYS + i])
+        {
+            i++;
+        }
+        return page[PAGE_KEYS + count + i];
+    }
+
+    bool leaf_contains(const vector<int> &page, int key)
+    {
+        for (int i = 0; i < page[1]; i++)
+        {
+            if (page[PAGE_KEYS + i] == key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+} // namespace
+
+namespace Tree
+{
+    /** ************************************************************
+    INPUT       : root of the tree, image path, page size in bytes
+    OPERATION   : Number the nodes breadth-first from page 1 on and
+    write every node to its page, header first.
+    @return false if a node does not fit a page or writing failed.
+    ************************************************************* */
+    bool PageFile::write(Node *root, const char *path, unsigned int page_size)
+    {
+        int capacity = root->get_capacity();
+        if ((PAGE_KEYS + 2 * capacity + 1) * sizeof(int) > page_size)
+        {
+            return false;
+        }
+
+        vector<Node *> order;
+        unordered_map<Node *, int> page;
+        queue<Node *> level;
+        level.push(root);
+        while (!level.empty())
+        {
+            Node *node = level.front();
+            level.pop();
+            page[node] = order.size() + 1;
+            order.push_back(node);
+            if (node->get_type() == TREE_INTERNAL || node->get_type() == TREE_ROOT_INTERNAL)
+            {
+                for (int i = 0; i <= node->get_keysize(); i++)
+                {
+                    level.push(node->get_child()[i]);
+                }
+            }
+        }
+
+        ofstream out(path, ios::out | ios::binary | ios::trunc);
+        vector<int> ints(page_size / sizeof(int), 0);
+        ints[0] = PAGE_MAGIC;
+        ints[1] = page_size;
+        ints[2] = 1;
+        ints[3] = order.size() + 1;
+        ints[4] = capacity;
+        out.write(reinterpret_cast<char *>(ints.data()), page_size);
+
+        for (unsigned int n = 0; n < order.size(); n++)
+        {
+            Node *node = order[n];
+            bool leaf = node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF;
+            int count = node->get_keysize();
+            fill(ints.begin(), ints.end(), 0);
+            ints[0] = leaf ? PAGE_LEAF : PAGE_INTERNAL;
+            ints[1] = count;
+            ints[2] = leaf && node->get_next() != NULL ? page[node->get_next()] : 0;
+            for (int i = 0; i < count; i++)
+            {
+                ints[PAGE_KEYS + i] = node->get_key(i);
+            }
+            for (int i = 0; !leaf && i <= count; i++)
+            {
+                ints[PAGE_KEYS + count + i] = page[node->get_child()[i]];
+            }
+            out.write(reinterpret_cast<char *>(ints.data()), page_size);
+        }
+        return static_cast<bool>(out);
+    }
+
+    /** Open an image and cache its root page; depth bounds the
+      * number of reads in flight.
+      */
+    PageFile::PageFile(const char *path, unsigned int depth)
+        : fd_(open(path, O_RDONLY)), depth_(depth < 2 ? 2 : depth), page_size_(0), pages_(0),
+          filter_(nullptr), reader_(depth_)
+    {
+        int header[5];
+        if (fd_ < 0 || pread(fd_, header, sizeof(header), 0) != sizeof(header) || header[0] != PAGE_MAGIC)
+        {
+            if (fd_ >= 0)
+            {
+                close(fd_);
+            }
+            fd_ = -1;
+            return;
+        }
+        page_size_ = header[1];
+        pages_ = header[3];
+        if (!read_page(header[2], root_))
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    PageFile::~PageFile()
+    {
+        vector<pair<unsigned long, int>> done;
+        while (reader_.in_flight() > 0)
+        {
+            reader_.wait(done, reader_.in_flight());
+        }
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    bool PageFile::is_open()
+    {
+        return fd_ >= 0;
+    }
+
+    bool PageFile::find(int key)
+    {
+        return find_batch(vector<int>(1, key))[0];
+    }
+
+    /** ************************************************************
+    INPUT       : keys to look up
+    OPERATION   : Run one lookup per reader slot, each a small state
+    machine that submits the read of its next page and
+    resumes when the read completes. A finished slot picks
+    up the next key, so the reader stays full.
+    @return for every key whether the image holds it.
+    ************************************************************* */
+    vector<bool> PageFile::find_batch(const vector<int> &keys)
+    {
+        vector<bool> found(keys.size(), false);
+        if (fd_ < 0)
+        {
+            return found;
+        }
+        unsigned int slots = keys.size() < depth_ ? keys.size() : depth_;
+        vector<vector<int>> buffer(slots);
+        vector<int> owner(slots, -1); // key index a slot works on
+        unsigned int next = 0;
+
+        vector<pair<unsigned long, int>> done;
+        for (unsigned int s = 0; s < slots; s++)
+        {
+            done.push_back(make_pair(s, -1)); // start every slot as if just freed
+        }
+        while (!done.empty())
+        {
+            for (unsigned int d = 0; d < done.size(); d++)
+            {
+                unsigned long s = done[d].first;
+                if (owner[s] >= 0)
+                {
+                    vector<int> &page = buffer[s];
+                    if (done[d].second == static_cast<int>(page_size_) && page[0] == PAGE_INTERNAL &&
+                        submit(child_page(page, keys[owner[s]]), page, s))
+                    {
+                        continue;
+                    }
+                    found[owner[s]] = done[d].second == static_cast<int>(page_size_) && leaf_contains(page, keys[owner[s]]);
+                    owner[s] = -1;
+                }
+                while (next < keys.size() && owner[s] < 0)
+                {
+                    int key = keys[next];
+                    if (filter_ != nullptr && !filter_->may_contain(key))
+                    { // certainly absent, no read needed
+                        next++;
+                        continue;
+                    }
+                    if (root_[0] == PAGE_LEAF)
+                    {
+                        found[next++] = leaf_contains(root_, key);
+                        continue;
+                    }
+                    if (submit(child_page(root_, key), buffer[s], s))
+                    {
+                        owner[s] = next;
+                    }
+                    next++;
+                }
+            }
+            done.clear();
+            if (reader_.in_flight() > 0 && reader_.wait(done, 1) < 0)
+            { // the ring failed and lost its reads, the reader uses pread
+              // from now on: the busy slots start their lookups over
+                for (unsigned int s = 0; s < slots; s++)
+                {
+                    if (owner[s] >= 0 && !submit(child_page(root_, keys[owner[s]]), buffer[s], s))
+                    {
+                        done.push_back(make_pair(s, -1)); // failed read, frees the slot
+                    }
+                }
+                reader_.wait(done, 1);
+            }
+        }
+        return found;
+    }
+
+    /** ************************************************************
+    INPUT       : range [lo, hi] of keys, leaf pages to read ahead
+    OPERATION   : Descend to the leaf of lo, then walk the leaf chain
+    while the following readahead pages are already being
+    read. Leaves sit on consecutive pages, so page p + k is
+    the guess for the k-th leaf after p; a guess is only used
+    if the next page number of the current leaf confirms it.
+    @return keys in the range, ascending.
+    ************************************************************* */
+    vector<int> PageFile::range_scan(int lo, int hi, unsigned int readahead)
+    {
+        vector<int> keys;
+        if (fd_ < 0 || lo > hi)
+        {
+            return keys;
+        }
+        vector<int> leaf = root_;
+        int current = 1; // root page
+        while (leaf[0] == PAGE_INTERNAL)
+        {
+            current = child_page(leaf, lo);
+            if (!read_page(current, leaf))
+            {
+                return keys;
+            }
+        }
+
+        unsigned int window = readahead < depth_ ? readahead : depth_ - 1; // one read left for misses
+        vector<vector<int>> buffer(window > 0 ? window : 1);
+        vector<int> page_of(buffer.size(), -1);
+        vector<bool> ready(buffer.size(), false);
+        int ahead = current + 1;
+        vector<pair<unsigned long, int>> done;
+        auto drain = [&]() {
+            while (reader_.in_flight() > 0)
+            {
+                done.clear();
+                reader_.wait(done, reader_.in_flight()); // a failed ring leaves none in flight
+            }
+            fill(page_of.begin(), page_of.end(), -1);
+        };
+
+        for (;;)
+        {
+            while (window > 0 && ahead < pages_ && ahead <= current + static_cast<int>(window))
+            {
+                int s = ahead % window;
+                page_of[s] = submit(ahead, buffer[s], s) ? ahead : -1;
+                ready[s] = false;
+                ahead++;
+            }
+
+            int count = leaf[1];
+            for (int i = 0; i < count; i++)
+            {
+                int key = leaf[PAGE_KEYS + i];
+                if (key >= lo && key <= hi)
+                {
+                    keys.push_back(key);
+                }
+            }
+            int next = leaf[2];
+            if (next == 0 || count == 0 || leaf[PAGE_KEYS + count - 1] >= hi)
+            {
+                break;
+            }
+
+            int s = window > 0 ? next % window : 0;
+            if (window > 0 && next > current && next < ahead && page_of[s] == next)
+            { // the guess was right, wait for it
+                while (!ready[s])
+                {
+                    done.clear();
+                    if (reader_.wait(done, 1) < 0)
+                    { // the ring failed and lost the readahead, read next with pread
+                        fill(page_of.begin(), page_of.end(), -1);
+                        break;
+                    }
+                    for (unsigned int d = 0; d < done.size(); d++)
+                    {
+                        ready[done[d].first] = done[d].second == static_cast<int>(page_size_);
+                        if (done[d].second != static_cast<int>(page_size_))
+                        {
+                            page_of[done[d].first] = -1;
+                        }
+                    }
+                    if (page_of[s] != next)
+                    {
+                        break;
+                    }
+                }
+            }
+            if (window > 0 && page_of[s] == next && ready[s])
+            {
+                leaf.swap(buffer[s]);
+                page_of[s] = -1;
+            }
+            else
+            { // wrong guess, restart the readahead behind next
+                ahead = next + 1;
+                drain();
+                if (!read_page(next, leaf))
+                {
+                    break;
+                }
+            }
+            current = next;
+        }
+
+        drain(); // buffers go away with this call
+        return keys;
+    }
+
+    bool PageFile::uring()
+    {
+        return reader_.uring();
+    }
+
+    /** Use filter, built from the tree the image was written from,
+      * to skip lookups of absent keys. nullptr detaches it.
+      */
+    void PageFile::set_filter(const KeyFilter *filter)
+    {
+        filter_ = filter;
+    }
+
+    /** Read one page and wait for it
+      */
+    bool PageFile::read_page(int page, vector<int> &buffer)
+    {
+        const unsigned long tag = ~0ul;
+        if (!submit(page, buffer, tag))
+        {
+            return false;
+        }
+        vector<pair<unsigned long, int>> done;
+        for (;;)
+        {
+            done.clear();
+            if (reader_.wait(done, 1) < 0)
+            { // the ring failed and lost the read, the reader uses pread now
+                return read_page(page, buffer);
+            }
+            for (unsigned int d = 0; d < done.size(); d++)
+            {
+                if (done[d].first == tag)
+                {
+                    return done[d].second == static_cast<int>(page_size_);
+                }
+            }
+        }
+    }
+
+    /** Start reading a page into buffer
+      * @return false if the page does not exist or the reader is full.
+      */
+    bool PageFile::submit(int page, vector<int> &buffer, unsigned long tag)
+    {
+        if (page <= 0 || page >= pages_)
+        {
+            return false;
+        }
+        buffer.resize(page_size_ / sizeof(int));
+        return reader_.submit(fd_, buffer.data(), page_size_, static_cast<long long>(page) * page_size_, tag);
+    }
+} // namespace Tree
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+
+#include "node.h"
+#include "async-io.h"
+#include "filter.h"
+
+namespace Tree
+{
+    /** Read-only, disk-resident image of a tree.
+      *
+      * write() stores one node per page in breadth-first order, so the
+      * leaves come last, in key order, on consecutive pages. A PageFile
+      * opened on the image keeps only the root page in memory and reads
+      * everything else through an AsyncReader: find_batch() keeps many
+      * lookups in flight from a single thread, and range_scan() reads
+      * ahead along the leaf chain, checking every guess against the
+      * next page number stored in the leaf. With a filter attached,
+      * keys it rejects are answered without any read.
+      */
+    class PageFile
+    {
+    public:
+        static const unsigned int PAGE = 4096;
+
+        static bool write(Node *root, const char *path, unsigned int page_size = PAGE);
+
+        PageFile(const char *path, unsigned int depth);
+        ~PageFile();
+        PageFile(const PageFile &) = delete;
+        PageFile &operator=(const PageFile &) = delete;
+
+        bool is_open();
+        bool find(int key);
+        std::vector<bool> find_batch(const std::vector<int> &keys);
+        std::vector<int> range_scan(int lo, int hi, unsigned int readahead);
+        bool uring();
+        void set_filter(const KeyFilter *filter);
+
+    private:
+        bool read_page(int page, std::vector<int> &buffer);
+        bool submit(int page, std::vector<int> &buffer, unsigned long tag);
+
+        int fd_;
+        unsigned int depth_;
+        unsigned int page_size_;
+        int pages_;
+        std::vector<int> root_;
+        const KeyFilter *filter_;
+        AsyncReader reader_;
+    };
+} // namespace Tree
@@ -0,0 +1,190 @@
+#include <algorithm>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "epoch.h"
+#include "radix.h"
+
+using namespace std;
+
+namespace
+{
+    /** Flip the sign bit, so unsigned byte order matches int order
+      */
+    unsigned int radix_key(int key)
+    {
+        return static_cast<unsigned int>(key) ^ 0x80000000u;
+    }
+
+    unsigned int radix_byte(unsigned int key, int level)
+    {
+        return (key >> (24 - 8 * level)) & 0xff;
+    }
+} // namespace
+
+namespace Tree
+{
+    /** Index the leaves of root. The tree is only read.
+      */
+    RadixIndex::RadixIndex(Node *root)
+        : root_(root), version_(read_begin(root))
+    {
+        for (Node *leaf = get_leftmost_leaf(root); leaf != NULL; leaf = leaf->get_next())
+        {
+            if (!leaf->isEmpty())
+            {
+                leaf_.push_back(leaf);
+                low_.push_back(radix_key(leaf->get_key(0)));
+            }
+        }
+        if (!leaf_.empty())
+        {
+            build(0, 0, leaf_.size());
+        }
+    }
+
+    /** ************************************************************
+    INPUT       : trie level, range of leaves sharing the first
+    level bytes of their low key
+    OPERATION   : Group the leaves by their byte at this level and
+    build a child for every group. On the last level the
+    children are leaf positions themselves.
+    @return position of the new node in node_.
+    ************************************************************* */
+    int RadixIndex::build(int level, int first, int last)
+    {
+        int id = node_.size();
+        node_.push_back(RadixNode());
+        node_[id].first = first;
+        node_[id].last = last - 1;
+        node_[id].base = byte_.size();
+        node_[id].rank = -1;
+
+        int size = 0;
+        for (int i = first; i < last; i++)
+        { // low keys are sorted, so a group is one run
+            if (i == first || radix_byte(low_[i], level) != radix_byte(low_[i - 1], level))
+            {
+                byte_.push_back(radix_byte(low_[i], level));
+                child_.push_back(i);
+                size++;
+            }
+        }
+        node_[id].size = size;
+
+        int base = node_[id].base;
+        if (level < 3)
+        {
+            for (int c = 0; c < size; c++)
+            {
+                int end = c + 1 < size ? child_[base + c + 1] : last;
+                child_[base + c] = build(level + 1, child_[base + c], end);
+            }
+        }
+        if (size > SMALL)
+        {
+            node_[id].rank = rank_.size();
+            int c = 0;
+            for (unsigned int b = 0; b < 256; b++)
+            {
+                while (c < size && byte_[base + c] <= b)
+                {
+                    c++;
+                }
+                rank_.push_back(c);
+            }
+        }
+        return id;
+    }
+
+    /** Find the child with the greatest byte not above byte
+      * @return its position among the children, -1 if there is none.
+      */
+    int RadixIndex::position(const RadixNode &node, unsigned int byte)
+    {
+        if (node.rank >= 0)
+        {
+            return rank_[node.rank + byte] - 1;
+        }
+        int c = 0;
+        while (c < node.size && byte_[node.base + c] <= byte)
+        {
+            c++;
+        }
+        return c - 1;
+    }
+
+    /** ************************************************************
+    INPUT       : integer key
+    OPERATION   : Follow the bytes of key down the trie. Where its
+    byte has no child, the leaf holding key is the last leaf
+    of the next smaller child, or the one before the node.
+    @return leaf that would hold key, nullptr if the index is stale.
+    ************************************************************* */
+    Node *RadixIndex::find_leaf(int key)
+    {
+        if (!is_fresh())
+        {
+            return nullptr;
+        }
+        if (leaf_.empty())
+        {
+            return root_;
+        }
+        unsigned int u = radix_key(key);
+        int id = 0;
+        for (int level = 0;; level++)
+        {
+            const RadixNode &node = node_[id];
+            int c = position(node, radix_byte(u, level));
+            if (c < 0)
+            {
+                return leaf_[max(node.first - 1, 0)];
+            }
+            int child = child_[node.base + c];
+            if (level == 3)
+            {
+                return leaf_[child];
+            }
+            if (byte_[node.base + c] != radix_byte(u, level))
+            {
+                return leaf_[node_[child].last];
+            }
+            id = child;
+        }
+    }
+
+    /** Look key up through the index, or by a normal descent when
+      * the tree changed after the index was built.
+      */
+    bool RadixIndex::find(int key)
+    {
+        Node *leaf = find_leaf(key);
+        if (leaf == nullptr)
+        {
+            return find_node(root_, key);
+        }
+        for (int i = 0; i < leaf->get_keysize(); i++)
+        {
+            if (leaf->get_key(i) == key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RadixIndex::is_fresh()
+    {
+        return read_validate(root_, version_);
+    }
+
+    /** Bytes held by the index, the leaves not included
+      */
+    size_t RadixIndex::memory()
+    {
+        return sizeof(*this) + leaf_.capacity() * sizeof(Node *) + low_.capacity() * sizeof(unsigned int) +
+               node_.capacity() * sizeof(RadixNode) + byte_.capacity() + child_.capacity() * sizeof(int) +
+               rank_.capacity() * sizeof(unsigned short);
+    }
+} // namespace Tree
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Radix index over the leaf layer, replacing the internal levels
+      * for lookups.
+      *
+      * The low key of every leaf is stored in a trie over the four bytes
+      * of the key, most significant byte first, so a lookup is at most
+      * four byte-indexed steps instead of a comparison per separator.
+      * Nodes adapt to their fan-out: up to SMALL children are kept as a
+      * sorted byte list, larger nodes get a 256-entry rank table. The
+      * leaves and their next chain are left untouched for range scans.
+      * Like LeafModel, the index goes stale on the first update and
+      * lookups then fall back to a normal descent.
+      */
+    class RadixIndex
+    {
+    public:
+        static const int SMALL = 16;
+
+        RadixIndex(Node *root);
+
+        bool find(int key);
+        Node *find_leaf(int key);
+        bool is_fresh();
+        size_t memory();
+
+    private:
+        struct RadixNode
+        {
+            int first; // leaf range covered by the node
+            int last;
+            int size;  // children in byte_ / child_ from base on
+            int base;
+            int rank;  // offset into rank_, -1 for small nodes
+        };
+
+        int build(int level, int first, int last);
+        int position(const RadixNode &node, unsigned int byte);
+
+        Node *root_;
+        unsigned long version_;
+        std::vector<Node *> leaf_;
+        std::vector<unsigned int> low_;
+        std::vector<RadixNode> node_;
+        std::vector<unsigned char> byte_;
+        std::vector<int> child_;
+        std::vector<unsigned short> rank_;
+    };
+} // namespace Tree
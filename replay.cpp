@@ -0,0 +1,376 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "epoch.h"
+#include "split-join.h"
+#include "replay.h"
+#include "stats.h"
+#include "upsert.h"
+
+using namespace std;
+
+namespace
+{
+    const char TRACE_MAGIC[4] = {'B', 'P', 'T', '1'};
+    const unsigned int BATCH = 1 << 16;
+
+    enum ReplayOp
+    {
+        REPLAY_INSERT,
+        REPLAY_DELETE,
+        REPLAY_FIND,
+        REPLAY_SCAN,
+        REPLAY_OP_COUNT
+    };
+
+    const char *replay_op_names[REPLAY_OP_COUNT] = {"insert", "delete", "find", "scan"};
+
+    int replay_op_of(char op)
+    {
+        switch (op)
+        {
+        case 'i':
+            return REPLAY_INSERT;
+        case 'd':
+            return REPLAY_DELETE;
+        case 'f':
+            return REPLAY_FIND;
+        case 's':
+            return REPLAY_SCAN;
+        default:
+            return -1;
+        }
+    }
+
+    void usage()
+    {
+        cout << "usage: b-plus-tree --replay <trace | -> [--capacity N] [--validate]" << endl
+             << "       b-plus-tree --convert <trace | -> <binary trace>" << endl;
+    }
+} // namespace
+
+/** ************************************************************
+INPUT       : file name, - for stdin, stream to open a file in
+OPERATION   : Open the input of a batch command.
+@return the stream to read, nullptr if the file cannot be opened.
+************************************************************* */
+istream *open_input(const string &source, ifstream &file)
+{
+    if (source == "-")
+    {
+        return &cin;
+    }
+    file.open(source.c_str(), ios::in | ios::binary);
+    if (!file)
+    {
+        cout << "cannot open " << source << endl;
+        return nullptr;
+    }
+    return &file;
+}
+
+/** ************************************************************
+INPUT       : --capacity argument, capacity to set
+OPERATION   : Parse a node capacity, reporting one below 3.
+@return false if the argument is not a valid capacity.
+************************************************************* */
+bool parse_capacity(const char *arg, unsigned int &capacity)
+{
+    int value = atoi(arg);
+    if (value < 3)
+    {
+        cout << "capacity should be greater than 2" << endl;
+        return false;
+    }
+    capacity = value;
+    return true;
+}
+
+/** ************************************************************
+INPUT       : command line arguments
+OPERATION   : --replay applies a trace from a file or stdin to a
+fresh tree and reports throughput and latency, --convert
+rewrites a trace in the binary format.
+@return process exit code.
+************************************************************* */
+int replay_main(int argc, char **argv)
+{
+    string replay;
+    string convert_in;
+    string convert_out;
+    ReplayOptions options;
+    options.capacity = 64;
+    options.validate = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--replay" && i + 1 < argc)
+        {
+            replay = argv[++i];
+        }
+        else if (arg == "--convert" && i + 2 < argc)
+        {
+            convert_in = argv[++i];
+            convert_out = argv[++i];
+        }
+        else if (arg == "--capacity" && i + 1 < argc)
+        {
+            if (!parse_capacity(argv[++i], options.capacity))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--validate")
+        {
+            options.validate = true;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    string source = replay.empty() ? convert_in : replay;
+    if (source.empty())
+    {
+        usage();
+        return 1;
+    }
+    ifstream file;
+    istream *in = open_input(source, file);
+    if (in == nullptr)
+    {
+        return 1;
+    }
+
+    if (!convert_out.empty())
+    {
+        ofstream out(convert_out.c_str(), ios::out | ios::binary);
+        out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        bool binary = is_binary_trace(*in);
+        vector<TraceOp> batch;
+        long long line = 0;
+        while (read_trace_batch(*in, binary, batch, BATCH, line))
+        {
+            for (unsigned int i = 0; i < batch.size(); i++)
+            {
+                write_binary_op(out, batch[i]);
+            }
+        }
+        return out ? 0 : 1;
+    }
+
+    Node *root = replay_trace(*in, options);
+    write_begin(root);
+    free_subtree(root);
+    write_end(root);
+    return 0;
+}
+
+/** ************************************************************
+INPUT       : trace stream, replay options
+OPERATION   : Stream the trace in batches, so parsing never shows up
+in the timings, apply every operation at full speed, and
+print throughput and latency percentiles per operation.
+Inserting a present key or deleting an absent one is
+counted and skipped, the tree holds every key once.
+@return root of the resulting tree.
+************************************************************* */
+Node *replay_trace(istream &in, const ReplayOptions &options)
+{
+    Node *root = new Node(options.capacity);
+    LatencyHistogram latency[REPLAY_OP_COUNT];
+    long long skipped = 0;
+    long long found = 0;
+    long long scanned = 0;
+    long long line = 0;
+    chrono::nanoseconds busy(0);
+
+    bool binary = is_binary_trace(in);
+    vector<TraceOp> batch;
+    while (read_trace_batch(in, binary, batch, BATCH, line))
+    {
+        for (unsigned int i = 0; i < batch.size(); i++)
+        {
+            const TraceOp &op = batch[i];
+            int kind = replay_op_of(op.op);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            switch (kind)
+            {
+            case REPLAY_INSERT:
+                skipped += !try_insert(root, op.key);
+                break;
+            case REPLAY_DELETE:
+                skipped += !erase_if(root, op.key, nullptr, nullptr);
+                break;
+            case REPLAY_FIND:
+                found += find_node(root, op.key);
+                break;
+            case REPLAY_SCAN:
+                scanned += range_scan(root, op.key, op.hi).size();
+                break;
+            }
+            chrono::nanoseconds spent = chrono::steady_clock::now() - start;
+            busy += spent;
+            latency[kind].record(spent.count());
+        }
+    }
+
+    long long total = 0;
+    for (int k = 0; k < REPLAY_OP_COUNT; k++)
+    {
+        total += latency[k].count();
+    }
+    double seconds = busy.count() / 1e9;
+    streamsize precision = cout.precision();
+    cout << fixed << setprecision(0);
+    cout << total << " ops in " << setprecision(3) << seconds << " s, "
+         << setprecision(0) << (seconds > 0 ? total / seconds : 0.0) << " ops/s" << endl;
+    cout << "op          count    mean ns     p50     p99   p99.9     max" << endl;
+    for (int k = 0; k < REPLAY_OP_COUNT; k++)
+    {
+        LatencyHistogram &h = latency[k];
+        if (h.count() == 0)
+        {
+            continue;
+        }
+        cout << left << setw(7) << replay_op_names[k] << right
+             << setw(11) << h.count() << setw(11) << h.mean()
+             << setw(8) << h.percentile(50) << setw(8) << h.percentile(99)
+             << setw(8) << h.percentile(99.9) << setw(8) << h.max() << endl;
+    }
+    cout << found << " finds hit, " << scanned << " keys scanned, "
+         << skipped << " duplicate inserts / absent deletes skipped" << endl;
+    cout.unsetf(ios::floatfield);
+    cout.precision(precision);
+
+    if (options.validate)
+    {
+        cout << (validate(root) ? "tree is valid" : "tree is broken!") << endl;
+    }
+    return root;
+}
+
+/** ************************************************************
+INPUT       : trace stream, its format, output batch, batch size,
+line counter for error messages
+OPERATION   : Parse up to limit operations into batch.
+Malformed text lines are reported and skipped; an unknown
+op in a binary trace is reported and ends the trace.
+@return false once the trace is exhausted.
+************************************************************* */
+bool read_trace_batch(istream &in, bool binary, vector<TraceOp> &batch, unsigned int limit, long long &line)
+{
+    batch.clear();
+    while (batch.size() < limit)
+    {
+        TraceOp op;
+        op.hi = 0;
+        if (binary)
+        {
+            unsigned char record[9] = {0};
+            if (!in.read(reinterpret_cast<char *>(record), 5))
+            {
+                break;
+            }
+            op.op = record[0];
+            if (replay_op_of(op.op) < 0)
+            { // the record length depends on the op, nothing after it can be trusted
+                cout << "unknown trace op '" << op.op << "', binary trace ends here" << endl;
+                in.setstate(ios::failbit);
+                break;
+            }
+            if (op.op == 's' && !in.read(reinterpret_cast<char *>(record) + 5, 4))
+            {
+                break;
+            }
+            op.key = static_cast<int>(record[1] | record[2] << 8 | record[3] << 16 | static_cast<unsigned int>(record[4]) << 24);
+            if (op.op == 's')
+            {
+                op.hi = static_cast<int>(record[5] | record[6] << 8 | record[7] << 16 | static_cast<unsigned int>(record[8]) << 24);
+            }
+        }
+        else
+        {
+            string text;
+            if (!getline(in, text))
+            {
+                break;
+            }
+            line++;
+            size_t first = text.find_first_not_of(" \t\r");
+            if (first == string::npos || text[first] == '#')
+            {
+                continue;
+            }
+            istringstream fields(text);
+            fields >> op.op >> op.key;
+            if (op.op == 's')
+            {
+                fields >> op.hi;
+            }
+            if (fields.fail())
+            {
+                cout << "line " << line << ": cannot parse \"" << text << "\"" << endl;
+                continue;
+            }
+        }
+        if (replay_op_of(op.op) < 0)
+        {
+            cout << "unknown trace op '" << op.op << "'" << endl;
+            continue;
+        }
+        batch.push_back(op);
+    }
+    return !batch.empty();
+}
+
+/** ************************************************************
+INPUT       : trace stream
+OPERATION   : Peek for the binary magic and consume it if present.
+@return true for a binary trace.
+************************************************************* */
+bool is_binary_trace(istream &in)
+{
+    char magic[sizeof(TRACE_MAGIC)];
+    for (unsigned int i = 0; i < sizeof(magic); i++)
+    {
+        int c = in.peek();
+        if (c == EOF || c != TRACE_MAGIC[i])
+        {
+            for (unsigned int j = i; j > 0; j--)
+            {
+                in.putback(magic[j - 1]);
+            }
+            return false;
+        }
+        magic[i] = static_cast<char>(in.get());
+    }
+    return true;
+}
+
+/** Write one operation in the binary trace format
+  */
+void write_binary_op(ostream &out, const TraceOp &op)
+{
+    unsigned char record[9];
+    unsigned int key = static_cast<unsigned int>(op.key);
+    unsigned int hi = static_cast<unsigned int>(op.hi);
+    record[0] = op.op;
+    for (int b = 0; b < 4; b++)
+    {
+        record[1 + b] = (key >> (8 * b)) & 0xff;
+        record[5 + b] = (hi >> (8 * b)) & 0xff;
+    }
+    out.write(reinterpret_cast<char *>(record), op.op == 's' ? 9 : 5);
+}
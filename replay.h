@@ -0,0 +1,47 @@
+#pragma once
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+using namespace Tree;
+
+/** One operation of a workload trace.
+  *
+  * Text traces hold one operation per line, '#' starts a comment:
+  *     i <key>          insert
+  *     d <key>          delete
+  *     f <key>          find
+  *     s <lo> <hi>      scan [lo, hi]
+  * Binary traces start with the magic "BPT1" followed by records of
+  * one op byte ('i', 'd', 'f', 's') and one little-endian int32 key,
+  * plus a second int32 for 's'.
+  */
+struct TraceOp
+{
+    char op;
+    int key;
+    int hi;
+};
+
+struct ReplayOptions
+{
+    unsigned int capacity;
+    bool validate;
+};
+
+istream* open_input(const string& source, ifstream& file);
+
+bool parse_capacity(const char* arg, unsigned int& capacity);
+
+int replay_main(int argc, char** argv);
+
+Node* replay_trace(istream& in, const ReplayOptions& options);
+
+bool read_trace_batch(istream& in, bool binary, vector<TraceOp>& batch, unsigned int limit, long long& line);
+
+bool is_binary_trace(istream& in);
+
+void write_binary_op(ostream& out, const TraceOp& op);
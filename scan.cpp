@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "scan.h"
+
+using namespace std;
+
+namespace Tree
+{
+    Predicate Predicate::all()
+    {
+        Predicate predicate;
+        predicate.type = PREDICATE_ALL;
+        predicate.lo = INT_MIN;
+        predicate.hi = INT_MAX;
+        predicate.mask = nullptr;
+        predicate.context = nullptr;
+        return predicate;
+    }
+
+    Predicate Predicate::range(int lo, int hi)
+    {
+        Predicate predicate = all();
+        predicate.type = PREDICATE_RANGE;
+        predicate.lo = lo;
+        predicate.hi = hi;
+        return predicate;
+    }
+
+    /** Keys equal to one of keys, in any order
+      */
+    Predicate Predicate::any_of(vector<int> keys)
+    {
+        Predicate predicate = all();
+        predicate.type = PREDICATE_IN;
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        predicate.in.swap(keys);
+        return predicate;
+    }
+
+    Predicate Predicate::masked(KeyMask mask, void *context)
+    {
+        Predicate predicate = all();
+        predicate.type = PREDICATE_MASK;
+        predicate.mask = mask;
+        predicate.context = context;
+        return predicate;
+    }
+
+    /** ************************************************************
+    INPUT       : Root node pointer, range [lo, hi] to scan, predicate
+    OPERATION   : Narrow the range by a range predicate, seek the leaf
+    of lo once and position the scan on its first key >= lo.
+    ************************************************************* */
+    LeafScan::LeafScan(Node *root, int lo, int hi, const Predicate &predicate)
+        : leaf_(nullptr), index_(0), lo_(lo), hi_(hi), predicate_(predicate), in_next_(0)
+    {
+        if (predicate_.type == PREDICATE_RANGE)
+        {
+            lo_ = max(lo_, predicate_.lo);
+            hi_ = min(hi_, predicate_.hi);
+        }
+        if (lo_ > hi_)
+        {
+            return;
+        }
+        if (predicate_.type == PREDICATE_IN)
+        {
+            in_next_ = lower_bound(predicate_.in.begin(), predicate_.in.end(), lo_) - predicate_.in.begin();
+        }
+        leaf_ = find_leaf(root, lo_);
+        index_ = count_below(leaf_->get_keys(), leaf_->get_keysize(), lo_);
+    }
+
+    /** ************************************************************
+    INPUT       : output buffer, its capacity
+    OPERATION   : Filter leaf after leaf from the current position and
+    write the matching keys, ascending, into keys. Stops when
+    the buffer is full, the position is kept for the next call.
+    @return number of keys written, less than capacity only
+    once the scan is done.
+    ************************************************************* */
+    size_t LeafScan::next(int *keys, size_t capacity)
+    {
+        size_t out = 0;
+        while (leaf_ != nullptr && out < capacity)
+        {
+            const int *data = leaf_->get_keys();
+            int size = leaf_->get_keysize();
+            int begin = index_;
+            int end = size;
+            if (size > 0 && data[size - 1] > hi_)
+            { // the last leaf of the range, hi_ < INT_MAX here
+                end = count_below(data, size, hi_ + 1);
+            }
+            bool finished = end < size;
+
+            switch (predicate_.type)
+            {
+            case PREDICATE_ALL:
+            case PREDICATE_RANGE:
+            {
+                size_t count = min(static_cast<size_t>(end - begin), capacity - out);
+                memcpy(keys + out, data + begin, count * sizeof(int));
+                out += count;
+                begin += count;
+                break;
+            }
+            case PREDICATE_IN:
+                while (begin < end && out < capacity)
+                {
+                    if (in_next_ >= predicate_.in.size())
+                    { // every wanted key is behind us
+                        begin = end;
+                        finished = true;
+                        break;
+                    }
+                    int want = predicate_.in[in_next_];
+                    begin = lower_bound(data + begin, data + end, want) - data;
+                    if (begin == end)
+                    { // want lies beyond this leaf
+                        break;
+                    }
+                    if (data[begin] == want)
+                    {
+                        keys[out++] = want;
+                        begin++;
+                    }
+                    in_next_++;
+                }
+                break;
+            case PREDICATE_MASK:
+                while (begin < end && out < capacity)
+                {
+                    int count = min(min(end - begin, 64), static_cast<int>(min(capacity - out, static_cast<size_t>(64))));
+                    uint64_t bits = predicate_.mask(data + begin, count, predicate_.context);
+                    if (count < 64)
+                    {
+                        bits &= (1ull << count) - 1;
+                    }
+                    while (bits != 0)
+                    { // compress the survivors
+                        keys[out++] = data[begin + __builtin_ctzll(bits)];
+                        bits &= bits - 1;
+                    }
+                    begin += count;
+                }
+                break;
+            }
+
+            index_ = begin;
+            if (begin < end)
+            { // buffer full
+                break;
+            }
+            if (finished)
+            {
+                leaf_ = nullptr;
+                break;
+            }
+            leaf_ = leaf_->get_next();
+            index_ = 0;
+        }
+        return out;
+    }
+
+    bool LeafScan::done() const
+    {
+        return leaf_ == nullptr;
+    }
+
+    /** Count the keys of an ascending array that are smaller than key,
+      * comparing a vector of keys at a time.
+      * @return index of the first key >= key, size if none.
+      */
+    int LeafScan::count_below(const int *keys, int size, int key)
+    {
+        int i = 0;
+#if defined(__AVX2__)
+        __m256i x = _mm256_set1_epi32(key);
+        for (; i + 8 <= size; i += 8)
+        {
+            __m256i less = _mm256_cmpgt_epi32(x, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(less));
+            if (mask != 0xff)
+            {
+                return i + __builtin_popcount(mask);
+            }
+        }
+#elif defined(__SSE2__)
+        __m128i x = _mm_set1_epi32(key);
+        for (; i + 4 <= size; i += 4)
+        {
+            __m128i less = _mm_cmpgt_epi32(x, _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(less));
+            if (mask != 0xf)
+            {
+                return i + __builtin_popcount(mask);
+            }
+        }
+#endif
+        while (i < size && keys[i] < key)
+        {
+            i++;
+        }
+        return i;
+    }
+} // namespace Tree
+
+/** ************************************************************
+INPUT       : Root node pointer, range [lo, hi] of keys, predicate
+OPERATION   : Run a LeafScan to the end, in batches written straight
+into the result.
+@return matching keys in ascending order.
+************************************************************* */
+vector<int> range_scan_where(Node *node, int lo, int hi, const Predicate &predicate)
+{
+    const size_t BATCH = 1024;
+    vector<int> keys;
+    LeafScan scan(node, lo, hi, predicate);
+    while (!scan.done())
+    {
+        size_t used = keys.size();
+        keys.resize(used + BATCH);
+        keys.resize(used + scan.next(keys.data() + used, BATCH));
+    }
+    return keys;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Filter callback over a run of at most 64 ascending keys.
+      * @return bit i set to keep keys[i].
+      */
+    typedef uint64_t (*KeyMask)(const int *keys, int count, void *context);
+
+    enum PredicateType
+    {
+        PREDICATE_ALL,
+        PREDICATE_RANGE, // lo <= key <= hi
+        PREDICATE_IN,    // key is one of in, sorted ascending
+        PREDICATE_MASK   // bit set by mask(keys, count, context)
+    };
+
+    struct Predicate
+    {
+        PredicateType type;
+        int lo;
+        int hi;
+        std::vector<int> in;
+        KeyMask mask;
+        void *context;
+
+        static Predicate all();
+        static Predicate range(int lo, int hi);
+        static Predicate any_of(std::vector<int> keys);
+        static Predicate masked(KeyMask mask, void *context);
+    };
+
+    /** Batched scan of [lo, hi] with a predicate pushed down to the leaves.
+      *
+      * Each leaf's key array is filtered in place: range bounds are
+      * found with SIMD compares and the surviving run is copied out as
+      * a block, set membership seeks through the run, and mask callbacks
+      * see up to 64 keys at a time. Matches are written into the
+      * caller's buffer, never through per-key accessor calls. Like the
+      * leaf chain, a scan must not overlap writes to the tree.
+      */
+    class LeafScan
+    {
+    public:
+        LeafScan(Node *root, int lo, int hi, const Predicate &predicate);
+
+        size_t next(int *keys, size_t capacity);
+        bool done() const;
+
+    private:
+        static int count_below(const int *keys, int size, int key);
+
+        Node *leaf_;
+        int index_;
+        int lo_;
+        int hi_;
+        Predicate predicate_;
+        size_t in_next_; // first element of predicate_.in not yet passed
+    };
+} // namespace Tree
+
+using namespace Tree;
+
+vector<int> range_scan_where(Node* node, int lo, int hi, const Predicate& predicate);
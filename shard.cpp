@@ -0,0 +1,451 @@
+#include <algorithm>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "split-join.h"
+#include "epoch.h"
+#include "upsert.h"
+#include "shard.h"
+
+using namespace std;
+
+namespace
+{
+    const long REBALANCE_SLACK = 1024;
+
+    /** Key at position rank in key order, read along the leaf chain
+      */
+    int key_at_rank(Node *root, long rank)
+    {
+        for (Node *leaf = get_leftmost_leaf(root); leaf != NULL; leaf = leaf->get_next())
+        {
+            if (rank < leaf->get_keysize())
+            {
+                return leaf->get_key(rank);
+            }
+            rank -= leaf->get_keysize();
+        }
+        return INT_MAX;
+    }
+} // namespace
+
+namespace Tree
+{
+    /** Start one worker per shard. The range [lo, hi] only sets the
+      * first boundaries; keys outside it go to the outer shards.
+      */
+    ShardedTree::ShardedTree(int shards, unsigned int capacity, int lo, int hi)
+        : writes_(0), rebalance_due_(false), stopping_(false)
+    {
+        if (shards < 1)
+        {
+            shards = 1;
+        }
+        long long width = (static_cast<long long>(hi) - lo + 1) / shards;
+        for (int i = 0; i < shards; i++)
+        {
+            bound_.push_back(i == 0 ? INT_MIN : static_cast<int>(lo + width * i));
+            Shard *shard = new Shard();
+            shard->root = new Node(capacity);
+            shard->size.store(0);
+            shard->stub.next.store(nullptr);
+            shard->head.store(&shard->stub);
+            shard->tail = &shard->stub;
+            shard->sleeping.store(false);
+            shard_.push_back(unique_ptr<Shard>(shard));
+        }
+        for (int i = 0; i < shards; i++)
+        {
+            shard_[i]->worker = thread(&ShardedTree::run, this, shard_[i].get());
+        }
+        rebalancer_ = thread(&ShardedTree::run_rebalancer, this);
+    }
+
+    /** Stop the rebalancer and the workers and free every tree
+      */
+    ShardedTree::~ShardedTree()
+    {
+        {
+            lock_guard<mutex> lock(rebalance_mutex_);
+            stopping_ = true;
+        }
+        rebalance_wake_.notify_one();
+        rebalancer_.join();
+        for (unsigned int i = 0; i < shard_.size(); i++)
+        {
+            request(i, SHARD_STOP, 0, 0, nullptr);
+        }
+        for (unsigned int i = 0; i < shard_.size(); i++)
+        {
+            shard_[i]->worker.join();
+            erase_range(shard_[i]->root, INT_MIN, INT_MAX);
+            delete shard_[i]->root;
+        }
+    }
+
+    /** Queue an insert; it is applied asynchronously by the owner
+      */
+    void ShardedTree::insert(int key)
+    {
+        {
+            shared_lock<shared_mutex> lock(route_mutex_);
+            request(route(key), SHARD_INSERT, key, 0, nullptr);
+        }
+        count_write();
+    }
+
+    /** Queue a delete; it is applied asynchronously by the owner
+      */
+    void ShardedTree::erase(int key)
+    {
+        {
+            shared_lock<shared_mutex> lock(route_mutex_);
+            request(route(key), SHARD_ERASE, key, 0, nullptr);
+        }
+        count_write();
+    }
+
+    /** Look key up. Sees every write this thread queued before.
+      */
+    bool ShardedTree::find(int key)
+    {
+        future<bool> done;
+        {
+            shared_lock<shared_mutex> lock(route_mutex_);
+            done = request(route(key), SHARD_FIND, key, 0, nullptr);
+        }
+        return done.get();
+    }
+
+    /** ************************************************************
+    INPUT       : range [lo, hi] of keys
+    OPERATION   : Hand the range to every shard overlapping it, so the
+    shards scan in parallel, and concatenate the results.
+    Shards hold disjoint ranges in key order, so the
+    concatenation is already sorted.
+    @return keys in the range, ascending.
+    ************************************************************* */
+    vector<int> ShardedTree::range_scan(int lo, int hi)
+    {
+        vector<int> keys;
+        if (lo > hi)
+        {
+            return keys;
+        }
+        vector<vector<int>> parts(shard_.size());
+        vector<future<bool>> done;
+        {
+            shared_lock<shared_mutex> lock(route_mutex_);
+            for (int i = route(lo); i <= route(hi); i++)
+            {
+                done.push_back(request(i, SHARD_SCAN, lo, hi, &parts[i]));
+            }
+        }
+        for (unsigned int i = 0; i < done.size(); i++)
+        {
+            done[i].get();
+        }
+        for (unsigned int i = 0; i < parts.size(); i++)
+        {
+            keys.insert(keys.end(), parts[i].begin(), parts[i].end());
+        }
+        return keys;
+    }
+
+    /** Wait until every request queued so far has been applied
+      */
+    void ShardedTree::sync()
+    {
+        vector<future<bool>> done;
+        {
+            shared_lock<shared_mutex> lock(route_mutex_);
+            for (unsigned int i = 0; i < shard_.size(); i++)
+            {
+                done.push_back(request(i, SHARD_SYNC, 0, 0, nullptr));
+            }
+        }
+        for (unsigned int i = 0; i < done.size(); i++)
+        {
+            done[i].get();
+        }
+    }
+
+    /** ************************************************************
+    OPERATION   : Block routing, drain all shards, and even out every
+    pair of neighbours where one holds more than twice the
+    keys of the other. The trees are touched from this
+    thread while their workers sit idle on empty queues.
+    @return true if a boundary moved.
+    ************************************************************* */
+    bool ShardedTree::rebalance()
+    {
+        unique_lock<shared_mutex> lock(route_mutex_);
+        vector<future<bool>> done;
+        for (unsigned int i = 0; i < shard_.size(); i++)
+        {
+            done.push_back(request(i, SHARD_SYNC, 0, 0, nullptr));
+        }
+        for (unsigned int i = 0; i < done.size(); i++)
+        {
+            done[i].get();
+        }
+
+        bool moved = false;
+        for (unsigned int i = 0; i + 1 < shard_.size(); i++)
+        {
+            long a = shard_[i]->size.load();
+            long b = shard_[i + 1]->size.load();
+            if (a > 2 * b + REBALANCE_SLACK || b > 2 * a + REBALANCE_SLACK)
+            {
+                move_boundary(i);
+                moved = true;
+            }
+        }
+        return moved;
+    }
+
+    /** ************************************************************
+    INPUT       : index of the left shard of a pair
+    OPERATION   : Move the boundary to the middle key of both shards:
+    split the larger tree there and join the split-off part
+    onto the smaller one.
+    ************************************************************* */
+    void ShardedTree::move_boundary(int left)
+    {
+        Shard *l = shard_[left].get();
+        Shard *r = shard_[left + 1].get();
+        long a = l->size.load();
+        long b = r->size.load();
+        long half = (a + b) / 2;
+        if (a > half)
+        { // keys from the boundary on go right
+            int bound = key_at_rank(l->root, half);
+            Node *moved = split_at(l->root, bound);
+            r->root = join(moved, r->root);
+            bound_[left + 1] = bound;
+        }
+        else
+        { // keys below the boundary go left
+            int bound = key_at_rank(r->root, half - a);
+            Node *rest = split_at(r->root, bound);
+            join(l->root, r->root);
+            r->root = rest;
+            bound_[left + 1] = bound;
+        }
+        l->size.store(half);
+        r->size.store(a + b - half);
+    }
+
+    /** Wake the rebalancer every REBALANCE_EVERY writes
+      */
+    void ShardedTree::count_write()
+    {
+        if (++writes_ % REBALANCE_EVERY == 0)
+        {
+            {
+                lock_guard<mutex> lock(rebalance_mutex_);
+                rebalance_due_ = true;
+            }
+            rebalance_wake_.notify_one();
+        }
+    }
+
+    /** ************************************************************
+    OPERATION   : Rebalancer thread: sleep until count_write() asks for
+    a rebalance() and run it, until the destructor stops it.
+    Wake-ups that arrive during a rebalance() fold into one.
+    ************************************************************* */
+    void ShardedTree::run_rebalancer()
+    {
+        unique_lock<mutex> lock(rebalance_mutex_);
+        for (;;)
+        {
+            rebalance_wake_.wait(lock, [this] { return rebalance_due_ || stopping_; });
+            if (stopping_)
+            {
+                return;
+            }
+            rebalance_due_ = false;
+            lock.unlock();
+            rebalance();
+            lock.lock();
+        }
+    }
+
+    long ShardedTree::size()
+    {
+        long total = 0;
+        for (unsigned int i = 0; i < shard_.size(); i++)
+        {
+            total += shard_[i]->size.load();
+        }
+        return total;
+    }
+
+    vector<long> ShardedTree::shard_sizes()
+    {
+        vector<long> sizes;
+        for (unsigned int i = 0; i < shard_.size(); i++)
+        {
+            sizes.push_back(shard_[i]->size.load());
+        }
+        return sizes;
+    }
+
+    vector<int> ShardedTree::boundaries()
+    {
+        shared_lock<shared_mutex> lock(route_mutex_);
+        return bound_;
+    }
+
+    /** Shard whose range holds key, callers hold route_mutex_
+      */
+    int ShardedTree::route(int key)
+    {
+        return upper_bound(bound_.begin(), bound_.end(), key) - bound_.begin() - 1;
+    }
+
+    /** Create a message, and a reply for everything but plain writes
+      * @return future of the reply, invalid for inserts and deletes.
+      */
+    future<bool> ShardedTree::request(int shard, ShardOp op, int key, int hi, vector<int> *keys)
+    {
+        Message *message = new Message();
+        message->op = op;
+        message->key = key;
+        message->hi = hi;
+        message->keys = keys;
+        message->reply = nullptr;
+        future<bool> done;
+        if (op != SHARD_INSERT && op != SHARD_ERASE)
+        {
+            message->reply = new promise<bool>();
+            done = message->reply->get_future();
+        }
+        post(shard, message);
+        return done;
+    }
+
+    /** Push onto the shard's queue (Vyukov's intrusive MPSC queue)
+      * and wake the worker if it went to sleep. The push and the check
+      * of sleeping pair with the worker's store of sleeping and check of
+      * head, so both sides are sequentially consistent: otherwise each
+      * could miss the other's write and the wakeup would be lost.
+      */
+    void ShardedTree::post(int index, Message *message)
+    {
+        Shard *shard = shard_[index].get();
+        message->next.store(nullptr, memory_order_relaxed);
+        Message *prev = shard->head.exchange(message, memory_order_seq_cst);
+        prev->next.store(message, memory_order_release);
+        if (shard->sleeping.load(memory_order_seq_cst))
+        {
+            lock_guard<mutex> lock(shard->mutex);
+            shard->wake.notify_one();
+        }
+    }
+
+    /** ************************************************************
+    INPUT       : shard, only called by its worker
+    OPERATION   : Take the oldest message off the queue. The stub
+    message keeps the queue non-empty, and is pushed back
+    when the last real message is taken.
+    @return the message, nullptr if the queue is empty or a
+    producer has not finished linking its message yet.
+    ************************************************************* */
+    ShardedTree::Message *ShardedTree::pop(Shard *shard)
+    {
+        Message *tail = shard->tail;
+        Message *next = tail->next.load(memory_order_acquire);
+        if (tail == &shard->stub)
+        {
+            if (next == nullptr)
+            {
+                return nullptr;
+            }
+            shard->tail = next;
+            tail = next;
+            next = next->next.load(memory_order_acquire);
+        }
+        if (next != nullptr)
+        {
+            shard->tail = next;
+            return tail;
+        }
+        if (tail != shard->head.load(memory_order_acquire))
+        {
+            return nullptr;
+        }
+        shard->stub.next.store(nullptr, memory_order_relaxed);
+        Message *prev = shard->head.exchange(&shard->stub, memory_order_acq_rel);
+        prev->next.store(&shard->stub, memory_order_release);
+        next = tail->next.load(memory_order_acquire);
+        if (next != nullptr)
+        {
+            shard->tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    /** ************************************************************
+    INPUT       : shard owned by the calling worker thread
+    OPERATION   : Apply messages in arrival order until told to stop,
+    sleeping while the queue is empty. The worker is the
+    only writer of its tree, so it skips the writer lock.
+    ************************************************************* */
+    void ShardedTree::run(Shard *shard)
+    {
+        OwnerGuard guard;
+        for (;;)
+        {
+            Message *message = pop(shard);
+            if (message == nullptr)
+            {
+                unique_lock<mutex> lock(shard->mutex);
+                shard->sleeping.store(true);
+                shard->wake.wait(lock, [shard] { return shard->head.load() != shard->tail; });
+                shard->sleeping.store(false);
+                continue;
+            }
+
+            bool result = true;
+            switch (message->op)
+            {
+            case SHARD_INSERT:
+                if (try_insert(shard->root, message->key))
+                {
+                    shard->size++;
+                }
+                break;
+            case SHARD_ERASE:
+                if (erase_if(shard->root, message->key, nullptr, nullptr))
+                {
+                    shard->size--;
+                }
+                break;
+            case SHARD_FIND:
+                result = find_node(shard->root, message->key);
+                break;
+            case SHARD_SCAN:
+                *message->keys = ::range_scan(shard->root, message->key, message->hi);
+                break;
+            case SHARD_SYNC:
+            case SHARD_STOP:
+                break;
+            }
+
+            bool stop = message->op == SHARD_STOP;
+            if (message->reply != nullptr)
+            {
+                message->reply->set_value(result);
+                delete message->reply;
+            }
+            delete message;
+            if (stop)
+            {
+                return;
+            }
+        }
+    }
+} // namespace Tree
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Range-partitioned front-end over independent trees.
+      *
+      * The key space is cut into one range per shard, and every shard's
+      * tree is owned by one worker thread that applies all operations on
+      * it, so no node is ever shared between writers. Callers only route
+      * a request by key and push it onto the shard's lock-free
+      * multi-producer queue. Scans collect the overlapping shards in key
+      * order. rebalance() moves a boundary between neighbours with
+      * split_at / join when their sizes drift apart. Every
+      * REBALANCE_EVERY writes it also runs on a rebalancer thread of its
+      * own, so the writer that crossed the mark only wakes it up.
+      */
+    class ShardedTree
+    {
+    public:
+        static const long REBALANCE_EVERY = 1 << 16;
+
+        ShardedTree(int shards, unsigned int capacity, int lo = INT_MIN, int hi = INT_MAX);
+        ~ShardedTree();
+        ShardedTree(const ShardedTree &) = delete;
+        ShardedTree &operator=(const ShardedTree &) = delete;
+
+        void insert(int key);
+        void erase(int key);
+        bool find(int key);
+        std::vector<int> range_scan(int lo, int hi);
+        void sync();
+        bool rebalance();
+
+        long size();
+        std::vector<long> shard_sizes();
+        std::vector<int> boundaries();
+
+    private:
+        enum ShardOp
+        {
+            SHARD_INSERT,
+            SHARD_ERASE,
+            SHARD_FIND,
+            SHARD_SCAN,
+            SHARD_SYNC,
+            SHARD_STOP
+        };
+
+        struct Message
+        {
+            std::atomic<Message *> next;
+            ShardOp op;
+            int key;
+            int hi;
+            std::vector<int> *keys;     // scan output, owned by the caller
+            std::promise<bool> *reply;  // set and deleted by the worker
+        };
+
+        struct Shard
+        {
+            Node *root;
+            std::atomic<long> size;
+            std::atomic<Message *> head; // producers push here
+            Message *tail;               // the worker pops here
+            Message stub;
+            std::atomic<bool> sleeping;
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::thread worker;
+        };
+
+        int route(int key);
+        void post(int shard, Message *message);
+        std::future<bool> request(int shard, ShardOp op, int key, int hi, std::vector<int> *keys);
+        Message *pop(Shard *shard);
+        void run(Shard *shard);
+        void move_boundary(int left);
+        void count_write();
+        void run_rebalancer();
+
+        std::vector<std::unique_ptr<Shard>> shard_;
+        std::vector<int> bound_; // shard i holds keys from bound_[i] on
+        std::shared_mutex route_mutex_;
+        std::atomic<long> writes_;
+        std::mutex rebalance_mutex_;
+        std::condition_variable rebalance_wake_;
+        bool rebalance_due_;
+        bool stopping_;
+        std::thread rebalancer_;
+    };
+} // namespace Tree
@@ -0,0 +1,427 @@
+#include <algorithm>
+#include <climits>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "split-join.h"
+#include "epoch.h"
+#include "aggregate.h"
+
+using namespace std;
+
+using Tree::Node;
+
+/*  Trees are handled here as (root pointer, nullptr when empty) pairs of
+*   subtrees whose nodes are all typed TREE_LEAF / TREE_INTERNAL.
+*   The public functions detach the caller's root node first and move the
+*   result back into it at the end, so a root pointer handed out before
+*   the operation keeps pointing at the root afterwards.
+*/
+
+/** ************************************************************
+INPUT       : Root node pointer, range [lo, hi] of keys to delete
+OPERATION   : Split the tree in front of lo and behind hi, drop the
+middle tree as a whole, and join the two outer trees.
+Only the two boundary paths are rebuilt, every subtree
+fully inside the range is retired without being visited
+key by key.
+************************************************************* */
+Node *erase_range(Node *node, int lo, int hi)
+{
+    if (lo > hi)
+    {
+        return node;
+    }
+    write_begin(node);
+    const Monoid *monoid = node->get_monoid();
+
+    Node *middle = nullptr;
+    Node *left = split_tree(detach_root(node), lo, &middle);
+    Node *right = nullptr;
+    if (hi < INT_MAX)
+    {
+        middle = split_tree(middle, hi + 1, &right);
+    }
+    free_subtree(middle);
+    transplant_root(node, join_trees(left, right));
+    if (monoid != nullptr)
+    {
+        repair_aggregates(node, monoid);
+    }
+
+    write_end(node);
+    return node;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key
+OPERATION   : Keys smaller than key stay in the tree of the given
+root, keys from key upward are moved into a new tree.
+@return root of the new tree.
+************************************************************* */
+Node *split_at(Node *node, int key)
+{
+    write_begin(node);
+    const Monoid *monoid = node->get_monoid();
+
+    Node *right = nullptr;
+    Node *left = split_tree(detach_root(node), key, &right);
+    transplant_root(node, left);
+
+    Node *root = new Node(node->get_capacity());
+    transplant_root(root, right);
+    if (monoid != nullptr)
+    {
+        repair_aggregates(node, monoid);
+        repair_aggregates(root, monoid);
+    }
+
+    write_end(node);
+    return root;
+}
+
+/** ************************************************************
+INPUT       : Root node pointers of two trees, every key of left
+not greater than any key of right
+OPERATION   : Concatenate right onto left. The root of left stays
+the root, right must not be used afterwards.
+************************************************************* */
+Node *join(Node *left, Node *right)
+{
+    write_begin(left);
+    const Monoid *monoid = left->get_monoid();
+
+    Node *joined = join_trees(detach_root(left), detach_root(right));
+    transplant_root(left, joined);
+    retire_node(right);
+    if (monoid != nullptr)
+    {
+        repair_aggregates(left, monoid);
+    }
+
+    write_end(left);
+    return left;
+}
+
+/** ************************************************************
+INPUT       : subtree, integer key, output for the right subtree
+OPERATION   : Recursively split the child that holds key, build
+the siblings left and right of it into two pieces,
+and join every piece with the matching half of the child.
+@return subtree of keys smaller than key.
+************************************************************* */
+Node *split_tree(Node *node, int key, Node **right)
+{
+    *right = nullptr;
+    if (node == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (node->get_type() == TREE_LEAF)
+    {
+        Node *upper = new Node(node->get_capacity());
+        upper->set_type(TREE_LEAF);
+        const int *keys = node->get_keys();
+        int size = node->get_keysize();
+        int first = lower_bound(keys, keys + size, key) - keys;
+        for (int i = first; i < size; i++)
+        { // appended in order, so every add_key lands at the end
+            upper->add_key(keys[i]);
+        }
+        node->trim_keys(first);
+        upper->set_next(node->get_next());
+        upper->set_prev(node);
+        node->set_next(upper);
+
+        if (upper->isEmpty())
+        {
+            node->set_next(upper->get_next());
+            delete upper;
+        }
+        else
+        {
+            if (upper->get_next() != nullptr)
+            {
+                upper->get_next()->set_prev(upper);
+            }
+            *right = upper;
+        }
+        if (node->isEmpty())
+        {
+            retire_node(node);
+            return nullptr;
+        }
+        return node;
+    }
+
+    int size = node->get_keysize();
+    int i = 0;
+    while (i < size && key > node->get_key(i))
+    { // child i is the only one that may hold keys on both sides
+        i++;
+    }
+
+    Node *child_right = nullptr;
+    Node *child_left = split_tree(node->get_child()[i], key, &child_right);
+
+    Node *left = join_trees(make_piece(node, 0, i), child_left);
+    *right = join_trees(child_right, make_piece(node, i + 1, size + 1));
+    retire_node(node);
+    return left;
+}
+
+/** ************************************************************
+INPUT       : two subtrees, every key of left <= every key of right
+OPERATION   : Hang the lower subtree into the matching level of the
+spine of the higher one, and split overflowing nodes on
+the way back up with insert_arrange.
+@return joined subtree.
+************************************************************* */
+Node *join_trees(Node *left, Node *right)
+{
+    if (left == nullptr)
+    {
+        return right;
+    }
+    if (right == nullptr)
+    {
+        return left;
+    }
+    get_rightmost_leaf(left)->set_next(get_leftmost_leaf(right));
+    get_leftmost_leaf(right)->set_prev(get_rightmost_leaf(left));
+
+    int left_height = tree_height(left);
+    int right_height = tree_height(right);
+    Node *top;
+    if (left_height == right_height)
+    {
+        /*       ┌───┐
+        *        │ 5 │ << new parent, key = smallest key of right
+        *       ┌┴───┴┐
+        *     left   right
+        */
+        top = new Node(left->get_capacity());
+        top->set_type(TREE_INTERNAL);
+        top->add_key(get_leftmost_leaf(right)->get_key(0));
+        top->set_child(left, 0);
+        top->set_child(right, 1);
+        return top;
+    }
+    else if (left_height > right_height)
+    {
+        attach_right(left, right, left_height, right_height);
+        top = left;
+    }
+    else
+    {
+        attach_left(right, left, right_height, left_height);
+        top = right;
+    }
+
+    if (top->isFull())
+    { // split the top through a temporary parent, as for CASE 3 - 2
+        Node *parent = new Node(top->get_capacity());
+        parent->set_type(TREE_INTERNAL);
+        parent->set_child(top, 0);
+        insert_arrange(parent);
+        top = parent;
+    }
+    return top;
+}
+
+/** ************************************************************
+INPUT       : subtree, lower subtree to hang in as the last child
+of the right-most node one level above sub_height
+OPERATION   : Follow the right spine down, attach, and split
+full children on the way back up.
+************************************************************* */
+void attach_right(Node *node, Node *sub, int node_height, int sub_height)
+{
+    node->set_monoid(nullptr); // its subtree changes, see repair_aggregates
+    if (node_height == sub_height + 1)
+    {
+        node->add_key(get_leftmost_leaf(sub)->get_key(0));
+        node->set_child(sub, node->get_keysize());
+        return;
+    }
+    Node *last = node->get_child()[node->get_keysize()];
+    attach_right(last, sub, node_height - 1, sub_height);
+    if (last->isFull())
+    {
+        insert_arrange(node);
+    }
+}
+
+/** ************************************************************
+INPUT       : subtree, lower subtree to hang in as the first child
+of the left-most node one level above sub_height
+OPERATION   : Follow the left spine down, attach, and split
+full children on the way back up.
+************************************************************* */
+void attach_left(Node *node, Node *sub, int node_height, int sub_height)
+{
+    node->set_monoid(nullptr);
+    if (node_height == sub_height + 1)
+    {
+        int separator = get_leftmost_leaf(node)->get_key(0);
+        for (int i = node->get_keysize() + 1; i > 0; i--)
+        {
+            node->set_child(node->get_child()[i - 1], i); // make space for sub
+        }
+        node->set_child(sub, 0);
+        node->add_key(separator);
+        return;
+    }
+    Node *first = node->get_child()[0];
+    attach_left(first, sub, node_height - 1, sub_height);
+    if (first->isFull())
+    {
+        insert_arrange(node);
+    }
+}
+
+/** ************************************************************
+INPUT       : internal node, range [first, last) of its children
+OPERATION   : Collect the children into a new internal node.
+@return nullptr for no child, the child itself for a
+single one, else the new node.
+************************************************************* */
+Node *make_piece(Node *node, int first, int last)
+{
+    if (last - first <= 0)
+    {
+        return nullptr;
+    }
+    if (last - first == 1)
+    {
+        return node->get_child()[first];
+    }
+    Node *piece = new Node(node->get_capacity());
+    piece->set_type(TREE_INTERNAL);
+    for (int i = first; i < last; i++)
+    {
+        if (i > first)
+        {
+            piece->add_key(node->get_key(i - 1));
+        }
+        piece->set_child(node->get_child()[i], i - first);
+    }
+    return piece;
+}
+
+/** Retire every node of a subtree, or of a whole tree from its root.
+  * Called with the writer lock held; the nodes go at write_end().
+  */
+void free_subtree(Node *node)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    if (node->get_type() == TREE_INTERNAL || node->get_type() == TREE_ROOT_INTERNAL)
+    {
+        for (int i = 0; i <= node->get_keysize(); i++)
+        {
+            free_subtree(node->get_child()[i]);
+        }
+    }
+    retire_node(node);
+}
+
+/** ************************************************************
+INPUT       : Root node pointer
+OPERATION   : Move the root's content into a fresh node typed as an
+inner node, so the root node itself can be refilled later.
+@return the fresh node, nullptr for an empty tree.
+************************************************************* */
+Node *detach_root(Node *node)
+{
+    if (node->get_type() == TREE_ROOT_LEAF && node->isEmpty())
+    {
+        return nullptr;
+    }
+    int capacity = node->get_capacity();
+    Node *copy = new Node(capacity);
+    for (int i = 0; i < node->get_keysize(); i++)
+    {
+        copy->add_key(node->get_key(i));
+    }
+    for (int i = 0; i < capacity + 1; i++)
+    {
+        copy->set_child(node->get_child()[i], i);
+    }
+    if (node->get_type() == TREE_ROOT_LEAF || node->get_type() == TREE_LEAF)
+    {
+        copy->set_type(TREE_LEAF);
+    }
+    else
+    {
+        copy->set_type(TREE_INTERNAL);
+    }
+    return copy;
+}
+
+/** ************************************************************
+INPUT       : Root node to refill, subtree (nullptr when empty)
+OPERATION   : Move the subtree's top node into root and retire it.
+************************************************************* */
+void transplant_root(Node *root, Node *from)
+{
+    int capacity = root->get_capacity();
+    while (!root->isEmpty())
+    {
+        root->del_key(root->get_key(root->get_keysize() - 1));
+    }
+    for (int i = 0; i < capacity + 1; i++)
+    {
+        root->set_child(from == nullptr ? nullptr : from->get_child()[i], i);
+    }
+    if (from != nullptr)
+    {
+        for (int i = 0; i < from->get_keysize(); i++)
+        {
+            root->add_key(from->get_key(i));
+        }
+    }
+
+    if (from == nullptr || from->get_type() == TREE_LEAF)
+    {
+        root->set_type(TREE_ROOT_LEAF);
+        root->set_next(nullptr);
+        root->set_prev(nullptr);
+    }
+    else
+    {
+        root->set_type(TREE_ROOT_INTERNAL);
+        get_rightmost_leaf(root)->set_next(nullptr); // cut the chain at both ends of the tree
+        get_leftmost_leaf(root)->set_prev(nullptr);
+    }
+    retire_node(from);
+}
+
+/** Count levels from node down to the leaves
+  * @return 1 for a leaf.
+  */
+int tree_height(Node *node)
+{
+    int height = 1;
+    while (node->get_type() != TREE_LEAF && node->get_type() != TREE_ROOT_LEAF)
+    {
+        node = node->get_child()[0];
+        height++;
+    }
+    return height;
+}
+
+/** Follow the right-most children down to a leaf
+  * @return pointer to the last leaf under node.
+  */
+Node *get_rightmost_leaf(Node *node)
+{
+    while (node->get_type() != TREE_LEAF && node->get_type() != TREE_ROOT_LEAF)
+    {
+        node = node->get_child()[node->get_keysize()];
+    }
+    return node;
+}
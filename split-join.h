@@ -0,0 +1,31 @@
+#pragma once
+
+#include "node.h"
+
+using namespace Tree;
+
+Node* erase_range(Node* node, int lo, int hi);
+
+Node* split_at(Node* node, int key);
+
+Node* join(Node* left, Node* right);
+
+Node* split_tree(Node* node, int key, Node** right);
+
+Node* join_trees(Node* left, Node* right);
+
+void attach_right(Node* node, Node* sub, int node_height, int sub_height);
+
+void attach_left(Node* node, Node* sub, int node_height, int sub_height);
+
+Node* make_piece(Node* node, int first, int last);
+
+void free_subtree(Node* node);
+
+Node* detach_root(Node* node);
+
+void transplant_root(Node* root, Node* from);
+
+int tree_height(Node* node);
+
+Node* get_rightmost_leaf(Node* node);
@@ -0,0 +1,370 @@
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+#include "node.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace Tree
+{
+    namespace
+    {
+        /** Counters of one thread. Only the owning thread writes them,
+          * collect_stats() reads them all without stopping anybody.
+          */
+        struct ThreadStats
+        {
+            atomic<unsigned long long> counter[STAT_COUNTER_COUNT];
+            LatencyHistogram latency[STAT_OP_COUNT];
+            ThreadStats *next;
+        };
+
+        mutex registry_mutex;
+        ThreadStats *registry = nullptr;
+
+        ThreadStats *local_stats()
+        {
+            thread_local ThreadStats *local = nullptr;
+            if (local == nullptr)
+            {
+                local = new ThreadStats();
+                for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+                {
+                    local->counter[i].store(0);
+                }
+                lock_guard<mutex> lock(registry_mutex);
+                local->next = registry;
+                registry = local;
+            }
+            return local;
+        }
+
+        const char *counter_names[STAT_COUNTER_COUNT] = {
+            "root leaf splits",
+            "root internal splits",
+            "leaf splits",
+            "internal splits",
+            "leaf borrows",
+            "leaf merges",
+            "internal borrows",
+            "internal merges",
+            "root collapses",
+            "compacted leaves"};
+
+        const char *op_names[STAT_OP_COUNT] = {"insert", "delete", "find", "scan", "update"};
+    } // namespace
+
+    LatencyHistogram::LatencyHistogram()
+    {
+        reset();
+    }
+
+    /** Record one value, in nanoseconds
+      */
+    void LatencyHistogram::record(unsigned long long nanos)
+    {
+        bucket_[bucket_of(nanos)].fetch_add(1, memory_order_relaxed);
+        count_.fetch_add(1, memory_order_relaxed);
+        sum_.fetch_add(nanos, memory_order_relaxed);
+        if (nanos > max_.load(memory_order_relaxed))
+        {
+            max_.store(nanos, memory_order_relaxed);
+        }
+    }
+
+    /** Add every value recorded by other to this histogram
+      */
+    void LatencyHistogram::merge(const LatencyHistogram &other)
+    {
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            bucket_[i].fetch_add(other.bucket_[i].load(memory_order_relaxed), memory_order_relaxed);
+        }
+        count_.fetch_add(other.count_.load(memory_order_relaxed), memory_order_relaxed);
+        sum_.fetch_add(other.sum_.load(memory_order_relaxed), memory_order_relaxed);
+        if (other.max_.load(memory_order_relaxed) > max_.load(memory_order_relaxed))
+        {
+            max_.store(other.max_.load(memory_order_relaxed), memory_order_relaxed);
+        }
+    }
+
+    void LatencyHistogram::reset()
+    {
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            bucket_[i].store(0, memory_order_relaxed);
+        }
+        count_.store(0, memory_order_relaxed);
+        sum_.store(0, memory_order_relaxed);
+        max_.store(0, memory_order_relaxed);
+    }
+
+    unsigned long long LatencyHistogram::count() const
+    {
+        return count_.load(memory_order_relaxed);
+    }
+
+    unsigned long long LatencyHistogram::max() const
+    {
+        return max_.load(memory_order_relaxed);
+    }
+
+    double LatencyHistogram::mean() const
+    {
+        unsigned long long n = count();
+        return n == 0 ? 0.0 : static_cast<double>(sum_.load(memory_order_relaxed)) / n;
+    }
+
+    /** Value below which p percent of the recorded values fall
+      * @return upper bound of the bucket holding that value.
+      */
+    unsigned long long LatencyHistogram::percentile(double p) const
+    {
+        unsigned long long n = count();
+        if (n == 0)
+        {
+            return 0;
+        }
+        unsigned long long rank = static_cast<unsigned long long>(p / 100.0 * n + 0.5);
+        if (rank < 1)
+        {
+            rank = 1;
+        }
+        unsigned long long seen = 0;
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            seen += bucket_[i].load(memory_order_relaxed);
+            if (seen >= rank)
+            {
+                unsigned long long top = bucket_top(i);
+                return top < max() ? top : max();
+            }
+        }
+        return max();
+    }
+
+    int LatencyHistogram::bucket_of(unsigned long long value)
+    {
+        if (value < (1ULL << SUB_BITS))
+        {
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        int sub = (value >> (exponent - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+        return ((exponent - SUB_BITS + 1) << SUB_BITS) + sub;
+    }
+
+    unsigned long long LatencyHistogram::bucket_top(int bucket)
+    {
+        if (bucket < (1 << SUB_BITS))
+        {
+            return bucket;
+        }
+        int exponent = (bucket >> SUB_BITS) + SUB_BITS - 1;
+        unsigned long long sub = bucket & ((1 << SUB_BITS) - 1);
+        unsigned long long width = 1ULL << (exponent - SUB_BITS);
+        return (((1ULL << SUB_BITS) + sub) << (exponent - SUB_BITS)) + width - 1;
+    }
+
+    void stats_count(StatCounter counter)
+    {
+        local_stats()->counter[counter].fetch_add(1, memory_order_relaxed);
+    }
+
+    void stats_record(StatOp op, unsigned long long nanos)
+    {
+        local_stats()->latency[op].record(nanos);
+    }
+
+    /** Sum the counters and histograms of every thread into snapshot
+      */
+    void collect_stats(StatsSnapshot &snapshot)
+    {
+        for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+        {
+            snapshot.counter[i] = 0;
+        }
+        for (int i = 0; i < STAT_OP_COUNT; i++)
+        {
+            snapshot.latency[i].reset();
+        }
+
+        lock_guard<mutex> lock(registry_mutex);
+        for (ThreadStats *t = registry; t != nullptr; t = t->next)
+        {
+            for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+            {
+                snapshot.counter[i] += t->counter[i].load(memory_order_relaxed);
+            }
+            for (int i = 0; i < STAT_OP_COUNT; i++)
+            {
+                snapshot.latency[i].merge(t->latency[i]);
+            }
+        }
+    }
+
+    void reset_stats()
+    {
+        lock_guard<mutex> lock(registry_mutex);
+        for (ThreadStats *t = registry; t != nullptr; t = t->next)
+        {
+            for (int i = 0; i < STAT_COUNTER_COUNT; i++)
+            {
+                t->counter[i].store(0, memory_order_relaxed);
+            }
+            for (int i = 0; i < STAT_OP_COUNT; i++)
+            {
+                t->latency[i].reset();
+            }
+        }
+    }
+
+    const char *stat_counter_name(StatCounter counter)
+    {
+        return counter_names[counter];
+    }
+
+    const char *stat_op_name(StatOp op)
+    {
+        return op_names[op];
+    }
+} // namespace Tree
+
+using namespace Tree;
+
+/** ************************************************************
+INPUT       : Root node pointer, whether to skip the leaves
+OPERATION   : Add up the bytes of every node, or of the internal
+nodes only, which is what a lookup has to keep cached.
+@return memory use split by keys, child arrays, node
+objects, buffers and allocator overhead.
+************************************************************* */
+MemoryUsage memory_usage(Node *node, bool internal_only)
+{
+    MemoryUsage usage;
+    vector<Node *> stack(1, node);
+    while (!stack.empty())
+    {
+        Node *curr = stack.back();
+        stack.pop_back();
+        if (curr->get_type() == TREE_LEAF || curr->get_type() == TREE_ROOT_LEAF)
+        {
+            if (!internal_only)
+            {
+                curr->add_memory(usage);
+            }
+            continue;
+        }
+        curr->add_memory(usage);
+        for (int i = 0; i <= curr->get_keysize(); i++)
+        {
+            stack.push_back(curr->get_child()[i]);
+        }
+    }
+    return usage;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer
+OPERATION   : Print height, nodes and keys per level, the fill
+distribution of leaves and internal nodes, and, when built
+with -DBPT_STATS, the split/merge counters and latency
+percentiles. Every node is visited once.
+************************************************************* */
+void print_stats(Node *node)
+{
+    int capacity = node->get_capacity();
+    int most = capacity - 1; // a node is split at capacity keys, so capacity - 1 keys is 100%
+    streamsize precision = cout.precision();
+    int leaf_fill[11] = {0};
+    int internal_fill[11] = {0};
+    long long total_keys = 0;
+    long long total_nodes = 0;
+
+    vector<Node *> level(1, node);
+    int depth = 0;
+    cout << "level    nodes        keys   avg fill" << endl;
+    while (!level.empty())
+    {
+        vector<Node *> below;
+        long long keys = 0;
+        bool leaf = level[0]->get_type() == TREE_LEAF || level[0]->get_type() == TREE_ROOT_LEAF;
+        for (Node *curr : level)
+        {
+            int size = curr->get_keysize();
+            keys += size;
+            int bucket = most > 0 ? size * 10 / most : 0;
+            if (bucket > 10)
+            {
+                bucket = 10;
+            }
+            (leaf ? leaf_fill : internal_fill)[bucket]++;
+            if (!leaf)
+            {
+                for (int i = 0; i <= size; i++)
+                {
+                    below.push_back(curr->get_child()[i]);
+                }
+            }
+        }
+        if (leaf)
+        {
+            total_keys = keys;
+        }
+        total_nodes += level.size();
+        cout << setw(5) << depth << setw(9) << level.size() << setw(12) << keys
+             << setw(10) << fixed << setprecision(1)
+             << (most > 0 ? 100.0 * keys / (static_cast<double>(level.size()) * most) : 0.0) << "%" << endl;
+        level.swap(below);
+        depth++;
+    }
+    cout << "height " << depth << ", " << total_nodes << " nodes, " << total_keys << " keys, capacity " << capacity << endl;
+
+    cout << "fill      leaves  internal" << endl;
+    for (int b = 0; b <= 10; b++)
+    {
+        if (leaf_fill[b] == 0 && internal_fill[b] == 0)
+        {
+            continue;
+        }
+        cout << setw(3) << b * 10 << "%" << (b < 10 ? "+" : " ") << setw(11) << leaf_fill[b] << setw(10) << internal_fill[b] << endl;
+    }
+
+    MemoryUsage usage = memory_usage(node);
+    MemoryUsage internal = memory_usage(node, true);
+    cout << "memory    " << setw(12) << usage.total() << " bytes, " << setprecision(1)
+         << (total_keys > 0 ? static_cast<double>(usage.total()) / total_keys : 0.0) << " per key, "
+         << internal.total() << " in internal nodes" << endl;
+    cout << "  keys    " << setw(12) << usage.key_bytes << endl;
+    cout << "  slack   " << setw(12) << usage.key_slack << endl;
+    cout << "  children" << setw(12) << usage.child_bytes << endl;
+    cout << "  nodes   " << setw(12) << usage.node_bytes << endl;
+    cout << "  buffers " << setw(12) << usage.buffer_bytes << endl;
+    cout << "  aggregates" << setw(10) << usage.aggregate_bytes << endl;
+    cout << "  overhead" << setw(12) << usage.allocator_bytes << endl;
+
+#ifdef BPT_STATS
+    Tree::StatsSnapshot snapshot;
+    Tree::collect_stats(snapshot);
+    for (int i = 0; i < Tree::STAT_COUNTER_COUNT; i++)
+    {
+        cout << setw(22) << Tree::stat_counter_name(static_cast<Tree::StatCounter>(i)) << " : " << snapshot.counter[i] << endl;
+    }
+    cout << "op          count    mean ns     p50     p99   p99.9     max" << endl;
+    for (int i = 0; i < Tree::STAT_OP_COUNT; i++)
+    {
+        Tree::LatencyHistogram &h = snapshot.latency[i];
+        cout << left << setw(7) << Tree::stat_op_name(static_cast<Tree::StatOp>(i)) << right
+             << setw(11) << h.count() << setw(11) << setprecision(0) << h.mean()
+             << setw(8) << h.percentile(50) << setw(8) << h.percentile(99)
+             << setw(8) << h.percentile(99.9) << setw(8) << h.max() << endl;
+    }
+#else
+    cout << "(build with -DBPT_STATS for split/merge counters and latencies)" << endl;
+#endif
+    cout.unsetf(ios::floatfield);
+    cout.precision(precision);
+}
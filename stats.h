@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Counters of what the tree is doing.
+      * Only collected when compiled with -DBPT_STATS, see STAT_COUNT.
+      */
+    enum StatCounter
+    {
+        STAT_ROOT_LEAF_SPLIT,     // insert_arrange CASE 1
+        STAT_ROOT_INTERNAL_SPLIT, // insert_arrange CASE 2
+        STAT_LEAF_SPLIT,          // insert_arrange CASE 3-1
+        STAT_INTERNAL_SPLIT,      // insert_arrange CASE 3-2
+        STAT_LEAF_BORROW,         // delete_arrange CASE 1, tmp == 1 or 2
+        STAT_LEAF_MERGE,          // delete_arrange CASE 1, tmp == 0
+        STAT_INTERNAL_BORROW,     // delete_arrange CASE 2, tmp == 1 or 2
+        STAT_INTERNAL_MERGE,      // delete_arrange CASE 2, tmp == 0
+        STAT_ROOT_COLLAPSE,
+        STAT_LEAF_COMPACT, // leaves freed by compact_parent
+        STAT_COUNTER_COUNT
+    };
+
+    enum StatOp
+    {
+        STAT_OP_INSERT,
+        STAT_OP_DELETE,
+        STAT_OP_FIND,
+        STAT_OP_SCAN,
+        STAT_OP_UPDATE, // update() and the calls built on it
+        STAT_OP_COUNT
+    };
+
+    /** HDR-style latency histogram.
+      * Buckets are log-linear: every power of two is cut into
+      * 2^SUB_BITS equal buckets, so any recorded value is off by
+      * less than 1 / 2^SUB_BITS relative to the reported one.
+      */
+    class LatencyHistogram
+    {
+    public:
+        static const int SUB_BITS = 3;
+        static const int BUCKETS = 64 << SUB_BITS;
+
+        LatencyHistogram();
+        void record(unsigned long long nanos);
+        void merge(const LatencyHistogram &other);
+        void reset();
+        unsigned long long count() const;
+        unsigned long long max() const;
+        double mean() const;
+        unsigned long long percentile(double p) const;
+
+    private:
+        static int bucket_of(unsigned long long value);
+        static unsigned long long bucket_top(int bucket);
+
+        std::atomic<unsigned long long> bucket_[BUCKETS];
+        std::atomic<unsigned long long> count_;
+        std::atomic<unsigned long long> sum_;
+        std::atomic<unsigned long long> max_;
+    };
+
+    struct StatsSnapshot
+    {
+        unsigned long long counter[STAT_COUNTER_COUNT];
+        LatencyHistogram latency[STAT_OP_COUNT];
+    };
+
+    void stats_count(StatCounter counter);
+    void stats_record(StatOp op, unsigned long long nanos);
+    void collect_stats(StatsSnapshot &snapshot);
+    void reset_stats();
+    const char *stat_counter_name(StatCounter counter);
+    const char *stat_op_name(StatOp op);
+
+    /** Times the enclosing scope into the latency histogram of op
+      */
+    class StatTimer
+    {
+    public:
+        StatTimer(StatOp op, bool active)
+            : op_(op), active_(active)
+        {
+            if (active_)
+            {
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+        ~StatTimer()
+        {
+            if (active_)
+            {
+                std::chrono::nanoseconds spent = std::chrono::steady_clock::now() - start_;
+                stats_record(op_, spent.count());
+            }
+        }
+
+    private:
+        StatOp op_;
+        bool active_;
+        std::chrono::steady_clock::time_point start_;
+    };
+} // namespace Tree
+
+#ifdef BPT_STATS
+#define STAT_COUNT(counter) Tree::stats_count(counter)
+#define STAT_TIMER(op, active) Tree::StatTimer stat_timer_(op, active)
+#else
+#define STAT_COUNT(counter)
+#define STAT_TIMER(op, active)
+#endif
+
+void print_stats(Tree::Node* node);
+
+Tree::MemoryUsage memory_usage(Tree::Node* node, bool internal_only = false);
@@ -0,0 +1,295 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "stats.h"
+#include "epoch.h"
+#include "split-join.h"
+#include "upsert.h"
+#include "tune.h"
+
+using namespace std;
+
+namespace
+{
+    size_t cache_size(int name, size_t fallback)
+    {
+        long size = sysconf(name);
+        return size > 0 ? static_cast<size_t>(size) : fallback;
+    }
+
+    /** Apply a workload to root, with the same rules as replay_trace
+      * @return root of the resulting tree.
+      */
+    Node *run_trace(Node *root, const vector<TraceOp> &trace, long long &checksum)
+    {
+        for (unsigned int i = 0; i < trace.size(); i++)
+        {
+            const TraceOp &op = trace[i];
+            switch (op.op)
+            {
+            case 'i':
+                try_insert(root, op.key);
+                break;
+            case 'd':
+                erase_if(root, op.key, nullptr, nullptr);
+                break;
+            case 'f':
+                checksum += find_node(root, op.key);
+                break;
+            case 's':
+                checksum += range_scan(root, op.key, op.hi).size();
+                break;
+            }
+        }
+        return root;
+    }
+
+    const char *cache_level(size_t bytes, const CacheInfo &cache)
+    {
+        if (bytes <= cache.l1)
+        {
+            return "L1";
+        }
+        if (bytes <= cache.l2)
+        {
+            return "L2";
+        }
+        if (bytes <= cache.l3)
+        {
+            return "L3";
+        }
+        return "DRAM";
+    }
+} // namespace
+
+/** Cache line and cache sizes, per core for L1 and L2
+  */
+CacheInfo cache_info()
+{
+    CacheInfo cache;
+    cache.line = cache_size(_SC_LEVEL1_DCACHE_LINESIZE, 64);
+    cache.l1 = cache_size(_SC_LEVEL1_DCACHE_SIZE, 32 << 10);
+    cache.l2 = cache_size(_SC_LEVEL2_CACHE_SIZE, 1 << 20);
+    cache.l3 = cache_size(_SC_LEVEL3_CACHE_SIZE, 16 << 20);
+    return cache;
+}
+
+/** ************************************************************
+INPUT       : cache hierarchy of the machine
+OPERATION   : Pick capacities whose key array, capacity + 1 keys as
+reserved by Node, fills exactly 1, 2, 4 .. 64 cache lines,
+so the binary search in a node never touches a line it
+only partly uses.
+@return candidate capacities, smallest first.
+************************************************************* */
+vector<unsigned int> tune_candidates(const CacheInfo &cache)
+{
+    vector<unsigned int> capacities;
+    for (size_t lines = 1; lines <= 64; lines *= 2)
+    {
+        size_t capacity = lines * cache.line / sizeof(int) - 1;
+        if (capacity >= 3)
+        {
+            capacities.push_back(static_cast<unsigned int>(capacity));
+        }
+    }
+    return capacities;
+}
+
+/** ************************************************************
+INPUT       : number of operations, random seed
+OPERATION   : Build the default tuning workload: half inserts of
+random keys, a quarter finds, a tenth deletes and the
+rest short scans.
+@return the workload as trace operations.
+************************************************************* */
+vector<TraceOp> synthetic_trace(long long count, unsigned int seed)
+{
+    mt19937 random(seed);
+    int range = static_cast<int>(count * 2);
+    vector<TraceOp> trace;
+    trace.reserve(count);
+    for (long long i = 0; i < count; i++)
+    {
+        TraceOp op;
+        unsigned int pick = random() % 100;
+        op.key = static_cast<int>(random() % range);
+        op.hi = 0;
+        if (pick < 50)
+        {
+            op.op = 'i';
+        }
+        else if (pick < 75)
+        {
+            op.op = 'f';
+        }
+        else if (pick < 85)
+        {
+            op.op = 'd';
+        }
+        else
+        {
+            op.op = 's';
+            op.hi = op.key + 100;
+        }
+        trace.push_back(op);
+    }
+    return trace;
+}
+
+/** ************************************************************
+INPUT       : workload, capacities to try, rounds per capacity
+OPERATION   : Run the workload on a fresh tree for every capacity,
+rounds times, keeping the fastest round to filter out
+noise, and measure the tree it leaves behind.
+@return one result per capacity.
+************************************************************* */
+vector<TuneResult> tune_capacity(const vector<TraceOp> &trace, const vector<unsigned int> &capacities, int rounds)
+{
+    vector<TuneResult> results;
+    long long checksum = 0;
+    for (unsigned int c = 0; c < capacities.size(); c++)
+    {
+        TuneResult result;
+        result.capacity = capacities[c];
+
+        Node *probe = new Node(result.capacity);
+        MemoryUsage empty;
+        probe->add_memory(empty);
+        result.node_bytes = empty.key_slack + empty.child_bytes;
+        delete probe;
+
+        result.ns_per_op = 0;
+        for (int r = 0; r < rounds || r == 0; r++)
+        {
+            Node *root = new Node(result.capacity);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            root = run_trace(root, trace, checksum);
+            chrono::nanoseconds spent = chrono::steady_clock::now() - start;
+            double ns = trace.empty() ? 0.0 : static_cast<double>(spent.count()) / trace.size();
+            if (r == 0 || ns < result.ns_per_op)
+            {
+                result.ns_per_op = ns;
+            }
+            result.height = tree_height(root);
+            result.memory = memory_usage(root);
+            result.internal_bytes = memory_usage(root, true).total();
+            write_begin(root);
+            free_subtree(root);
+            write_end(root);
+        }
+        results.push_back(result);
+    }
+    if (checksum == -1)
+    { // keeps the finds and scans from being optimized away
+        cout << checksum << endl;
+    }
+    return results;
+}
+
+/** ************************************************************
+INPUT       : tuning results, cache hierarchy
+OPERATION   : Print one line per capacity, with where its internal
+nodes fit in the cache hierarchy, and recommend the one
+with the fewest bytes per key among those within 5% of
+the fastest.
+@return recommended capacity, 0 without results.
+************************************************************* */
+unsigned int print_tuning(const vector<TuneResult> &results, const CacheInfo &cache)
+{
+    if (results.empty())
+    {
+        return 0;
+    }
+    double fastest = results[0].ns_per_op;
+    for (unsigned int i = 1; i < results.size(); i++)
+    {
+        if (results[i].ns_per_op < fastest)
+        {
+            fastest = results[i].ns_per_op;
+        }
+    }
+
+    streamsize precision = cout.precision();
+    cout << "cache line " << cache.line << ", L1 " << (cache.l1 >> 10) << " KiB, L2 " << (cache.l2 >> 10)
+         << " KiB, L3 " << (cache.l3 >> 10) << " KiB" << endl;
+    cout << "capacity  node bytes  height   ns/op  bytes/key  internal bytes" << endl;
+    unsigned int best = 0;
+    double best_bytes = 0;
+    cout << fixed << setprecision(1);
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const TuneResult &r = results[i];
+        double bytes = r.memory.keys > 0 ? static_cast<double>(r.memory.total()) / r.memory.keys : 0.0;
+        cout << setw(8) << r.capacity << setw(12) << r.node_bytes << setw(8) << r.height
+             << setw(8) << r.ns_per_op << setw(11) << bytes
+             << setw(12) << r.internal_bytes << " " << cache_level(r.internal_bytes, cache) << endl;
+        if (r.ns_per_op <= fastest * 1.05 && (best == 0 || bytes < best_bytes))
+        {
+            best = r.capacity;
+            best_bytes = bytes;
+        }
+    }
+    cout << "recommended capacity " << best << endl;
+    cout.unsetf(ios::floatfield);
+    cout.precision(precision);
+    return best;
+}
+
+/** ************************************************************
+INPUT       : command line arguments
+OPERATION   : --tune runs a trace from a file or stdin, or a
+synthetic workload without --replay, at the candidate
+capacities of this machine and recommends one.
+@return process exit code.
+************************************************************* */
+int tune_main(int argc, char **argv)
+{
+    string replay;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--replay" && i + 1 < argc)
+        {
+            replay = argv[++i];
+        }
+        else if (arg != "--tune")
+        {
+            cout << "usage: b-plus-tree --tune [--replay <trace | ->]" << endl;
+            return 1;
+        }
+    }
+
+    vector<TraceOp> trace;
+    if (replay.empty())
+    {
+        trace = synthetic_trace(200000, 1);
+    }
+    else
+    {
+        ifstream file;
+        istream *in = open_input(replay, file);
+        if (in == nullptr)
+        {
+            return 1;
+        }
+        vector<TraceOp> batch;
+        bool binary = is_binary_trace(*in);
+        long long line = 0;
+        while (read_trace_batch(*in, binary, batch, 1 << 16, line))
+        {
+            trace.insert(trace.end(), batch.begin(), batch.end());
+        }
+    }
+    CacheInfo cache = cache_info();
+    print_tuning(tune_capacity(trace, tune_candidates(cache), 3), cache);
+    return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "node.h"
+#include "replay.h"
+
+using namespace Tree;
+
+/** Cache hierarchy of the machine, from sysconf with common defaults
+  * where the system does not tell.
+  */
+struct CacheInfo
+{
+    size_t line;
+    size_t l1;
+    size_t l2;
+    size_t l3;
+};
+
+/** Outcome of running a workload at one capacity
+  */
+struct TuneResult
+{
+    unsigned int capacity;
+    size_t node_bytes;     // key array plus child array of one node
+    double ns_per_op;      // best of the rounds
+    int height;
+    MemoryUsage memory;    // of the tree the workload leaves behind
+    size_t internal_bytes; // of its internal nodes only
+};
+
+CacheInfo cache_info();
+
+vector<unsigned int> tune_candidates(const CacheInfo& cache);
+
+vector<TraceOp> synthetic_trace(long long count, unsigned int seed);
+
+vector<TuneResult> tune_capacity(const vector<TraceOp>& trace, const vector<unsigned int>& capacities, int rounds);
+
+unsigned int print_tuning(const vector<TuneResult>& results, const CacheInfo& cache);
+
+int tune_main(int argc, char** argv);
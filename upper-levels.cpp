@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "node.h"
+#include "b-plus-tree.h"
+#include "epoch.h"
+#include "huge-pages.h"
+#include "upper-levels.h"
+
+using namespace std;
+
+namespace
+{
+    bool is_leaf(Node *node)
+    {
+        TreeNodeType type = node->load_type();
+        return type == TREE_LEAF || type == TREE_ROOT_LEAF;
+    }
+
+    size_t round_up(size_t bytes, size_t unit)
+    {
+        return (bytes + unit - 1) / unit * unit;
+    }
+
+    /** Offset of the child references in a record of keys key slots:
+      * the key count, the keys, then 8-byte aligned references.
+      */
+    size_t child_offset(int keys)
+    {
+        return round_up((1 + keys) * sizeof(int), sizeof(uintptr_t));
+    }
+} // namespace
+
+namespace Tree
+{
+    /** Copy the internal levels of the tree below root, binding the
+      * copy to numa_node, or leaving it to first touch for -1.
+      */
+    UpperLevels::UpperLevels(Node *root, int numa_node)
+        : root_(root), numa_node_(numa_node), version_(0), region_(nullptr), bytes_(0),
+          records_(0), bottom_(0), keys_(0), stride_(0)
+    {
+        rebuild();
+    }
+
+    UpperLevels::~UpperLevels()
+    {
+        huge_region_free(region_, bytes_);
+    }
+
+    /** ************************************************************
+    OPERATION   : Collect the internal nodes level by level, the root
+    first, size the records by the fullest one and write
+    them into a fresh region. Like snapshot_find, the walk
+    runs inside an epoch and is repeated whenever a writer
+    changed the tree meanwhile. The old copy is released.
+    ************************************************************* */
+    void UpperLevels::rebuild()
+    {
+        EpochGuard guard;
+        while (true)
+        {
+            unsigned long version = read_begin(root_);
+            vector<Node *> order; // internal nodes, breadth-first
+            size_t bottom = 0;
+            int keys = 0;
+            bool torn = false;
+            if (!is_leaf(root_))
+            {
+                order.push_back(root_);
+            }
+            size_t begin = 0;
+            for (int depth = 0; begin < order.size() && !torn; depth++)
+            {
+                size_t end = order.size();
+                bool leaves = false;
+                bool internals = false;
+                for (size_t i = begin; i < end && !torn; i++)
+                {
+                    int size = order[i]->load_keysize();
+                    keys = max(keys, size);
+                    for (int c = 0; c <= size; c++)
+                    {
+                        Node *child = order[i]->load_child(c);
+                        if (child == nullptr)
+                        {
+                            torn = true;
+                            break;
+                        }
+                        if (is_leaf(child))
+                        {
+                            leaves = true;
+                        }
+                        else
+                        {
+                            internals = true;
+                            order.push_back(child);
+                        }
+                    }
+                }
+                if (leaves)
+                {
+                    bottom = begin;
+                }
+                // all leaves sit on one level, anything else raced with a writer
+                torn = torn || (leaves && internals) || depth > 64;
+                begin = end;
+            }
+            if (torn)
+            {
+                continue;
+            }
+
+            size_t stride = round_up(child_offset(keys) + (keys + 1) * sizeof(uintptr_t), 64);
+            size_t bytes = order.size() * stride;
+            char *region = order.empty() ? nullptr : static_cast<char *>(huge_region(bytes, numa_node_));
+            size_t next = 1;
+            for (size_t r = 0; r < order.size(); r++)
+            {
+                int *record = reinterpret_cast<int *>(region + r * stride);
+                uintptr_t *child = reinterpret_cast<uintptr_t *>(region + r * stride + child_offset(keys));
+                int size = min(order[r]->load_keysize(), keys);
+                record[0] = size;
+                for (int i = 0; i < size; i++)
+                {
+                    record[1 + i] = order[r]->load_key(i);
+                }
+                for (int c = 0; c <= size; c++)
+                {
+                    if (r < bottom)
+                    {
+                        child[c] = min(next++, order.size() - 1);
+                    }
+                    else
+                    {
+                        child[c] = reinterpret_cast<uintptr_t>(order[r]->load_child(c));
+                    }
+                }
+            }
+            if (!read_validate(root_, version))
+            {
+                huge_region_free(region, bytes);
+                continue;
+            }
+
+            huge_region_free(region_, bytes_);
+            region_ = region;
+            bytes_ = bytes;
+            records_ = order.size();
+            bottom_ = bottom;
+            keys_ = keys;
+            stride_ = stride;
+            version_ = version;
+            return;
+        }
+    }
+
+    /** Check whether a write happened since the copy was taken
+      */
+    bool UpperLevels::stale() const
+    {
+        return !read_validate(root_, version_);
+    }
+
+    /** ************************************************************
+    INPUT       : integer key
+    OPERATION   : Descend the records instead of the tree's internal
+    nodes, choosing children like find_node.
+    @return the leaf that holds key if the tree does, as of
+    the version of the copy.
+    ************************************************************* */
+    Node *UpperLevels::find_leaf(int key) const
+    {
+        if (records_ == 0)
+        {
+            return root_;
+        }
+        size_t r = 0;
+        while (true)
+        {
+            const int *record = reinterpret_cast<const int *>(region_ + r * stride_);
+            const uintptr_t *child = reinterpret_cast<const uintptr_t *>(region_ + r * stride_ + child_offset(keys_));
+            int i = 0;
+            int size = record[0];
+            while (i < size && key >= record[1 + i])
+            {
+                i++;
+            }
+            if (r >= bottom_)
+            {
+                return reinterpret_cast<Node *>(child[i]);
+            }
+            r = child[i];
+        }
+    }
+
+    /** ************************************************************
+    INPUT       : integer key to find
+    OPERATION   : Look key up through the copy if it is current, and
+    through the tree with snapshot_find() otherwise or if a
+    writer got in between.
+    ************************************************************* */
+    bool UpperLevels::find(int key) const
+    {
+        {
+            EpochGuard guard;
+            unsigned long version = read_begin(root_);
+            if (version == version_)
+            {
+                Node *leaf = find_leaf(key);
+                bool found = false;
+                int size = leaf->load_keysize();
+                for (int i = 0; i < size; i++)
+                {
+                    if (leaf->load_key(i) == key)
+                    {
+                        found = true;
+                        break;
+                    }
+                }
+                if (read_validate(root_, version))
+                {
+                    return found;
+                }
+            }
+        }
+        Node *root = root_;
+        return snapshot_find(&root, key);
+    }
+
+    /** Bytes held by the copy
+      */
+    size_t UpperLevels::memory() const
+    {
+        return sizeof(*this) + bytes_;
+    }
+
+    /** Copy the internal levels of the tree once per NUMA node
+      */
+    ReplicatedLevels::ReplicatedLevels(Node *root)
+    {
+        int nodes = numa_nodes();
+        for (int i = 0; i < nodes; i++)
+        {
+            replica_.push_back(new UpperLevels(root, nodes > 1 ? i : -1));
+        }
+    }
+
+    ReplicatedLevels::~ReplicatedLevels()
+    {
+        for (unsigned int i = 0; i < replica_.size(); i++)
+        {
+            delete replica_[i];
+        }
+    }
+
+    /** Bring every copy up to date after writes
+      */
+    void ReplicatedLevels::rebuild()
+    {
+        for (unsigned int i = 0; i < replica_.size(); i++)
+        {
+            replica_[i]->rebuild();
+        }
+    }
+
+    bool ReplicatedLevels::find(int key) const
+    {
+        return local().find(key);
+    }
+
+    /** @return the copy on the calling thread's NUMA node.
+      */
+    const UpperLevels &ReplicatedLevels::local() const
+    {
+        unsigned int node = numa_node();
+        return *replica_[node < replica_.size() ? node : 0];
+    }
+
+    int ReplicatedLevels::replicas() const
+    {
+        return replica_.size();
+    }
+} // namespace Tree
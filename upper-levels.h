@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "node.h"
+
+namespace Tree
+{
+    /** Packed copy of the internal levels of a tree.
+      *
+      * Internal nodes are laid out breadth-first as fixed-size records
+      * of keys and child references, root first, in one huge page region
+      * that may be bound to a NUMA node. The top levels share a few cache
+      * lines and the whole copy a few TLB entries, where the tree's own
+      * internal nodes are spread over the heap. Bottom records point at
+      * the tree's leaves, which are not copied.
+      * The copy remembers the tree version (see epoch.h) it was taken
+      * at. Lookups validate against it like snapshot_find and fall back
+      * to the tree once a write changed it, until rebuild().
+      */
+    class UpperLevels
+    {
+    public:
+        UpperLevels(Node *root, int numa_node = -1);
+        ~UpperLevels();
+        UpperLevels(const UpperLevels &) = delete;
+        UpperLevels &operator=(const UpperLevels &) = delete;
+
+        void rebuild();
+        bool stale() const;
+        bool find(int key) const;
+        Node *find_leaf(int key) const;
+        size_t memory() const;
+
+    private:
+        Node *root_;
+        int numa_node_;
+        unsigned long version_;
+        char *region_;
+        size_t bytes_;
+        size_t records_;
+        size_t bottom_; // first record whose children are leaves
+        int keys_;      // key slots per record
+        size_t stride_; // bytes per record
+    };
+
+    /** One UpperLevels per NUMA node. Lookups go through the copy on
+      * the node the calling thread runs on, so the read-mostly internal
+      * levels are never fetched across the interconnect.
+      */
+    class ReplicatedLevels
+    {
+    public:
+        ReplicatedLevels(Node *root);
+        ~ReplicatedLevels();
+        ReplicatedLevels(const ReplicatedLevels &) = delete;
+        ReplicatedLevels &operator=(const ReplicatedLevels &) = delete;
+
+        void rebuild();
+        bool find(int key) const;
+        const UpperLevels &local() const;
+        int replicas() const;
+
+    private:
+        std::vector<UpperLevels *> replica_;
+    };
+} // namespace Tree
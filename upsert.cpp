@@ -0,0 +1,164 @@
+#include "node.h"
+#include "b-plus-tree.h"
+#include "epoch.h"
+#include "stats.h"
+#include "aggregate.h"
+#include "fixed-capacity.h"
+#include "upsert.h"
+#include "change-feed.h"
+
+using namespace std;
+
+namespace
+{
+    enum Change
+    {
+        CHANGE_NONE,
+        CHANGE_INSERTED,
+        CHANGE_ERASED
+    };
+
+    /** ************************************************************
+    INPUT       : node on the path of key, update callback, its context
+    OPERATION   : Dive to the leaf of key, let the callback decide on
+    it and apply its action there. On the way back up, the
+    nodes of the recorded path are rearranged exactly as
+    insert_node() or delete_node() would after the same change,
+    and nothing is touched when the tree stayed the same.
+    @return what changed in the leaf.
+    ************************************************************* */
+    Change update_node(Node *node, int key, UpdateFunction function, void *context)
+    {
+        if (node->get_type() == TREE_LEAF || node->get_type() == TREE_ROOT_LEAF)
+        {
+            int size = node->get_keysize();
+            int i = key_rank<false>(node->get_keys(), size, node->get_capacity(), key);
+            bool present = i < size && node->get_key(i) == key;
+            UpdateAction action = function(key, present, context);
+            if (action == UPDATE_INSERT && !present)
+            {
+                node->add_key(key);
+                feed_record(FEED_INSERT, key);
+                if (node->get_type() == TREE_ROOT_LEAF && node->isFull())
+                {
+                    insert_arrange(node);
+                }
+                return CHANGE_INSERTED;
+            }
+            if (action == UPDATE_ERASE && present)
+            {
+                node->del_key(key);
+                feed_record(FEED_ERASE, key);
+                return CHANGE_ERASED;
+            }
+            return CHANGE_NONE; // kept, or assigned with the key itself
+        }
+
+        int i = key_rank<true>(node->get_keys(), node->get_keysize(), node->get_capacity(), key);
+        Change change = update_node(node->get_child()[i], key, function, context);
+        if (change == CHANGE_INSERTED)
+        { // see insert_node
+            update_aggregate(node, i);
+            if (node->get_child()[i]->isFull())
+            {
+                insert_arrange(node);
+            }
+            if (node->get_type() == TREE_ROOT_INTERNAL && node->isFull())
+            {
+                insert_arrange(node);
+            }
+        }
+        else if (change == CHANGE_ERASED)
+        { // see delete_node
+            update_aggregate(node, i);
+            key_update(node, key);
+            if (node->get_child()[i]->isEmpty())
+            {
+                delete_arrange(node);
+            }
+            if (node->get_type() == TREE_ROOT_INTERNAL && node->isEmpty())
+            {
+                collapse_root(node);
+            }
+        }
+        return change;
+    }
+
+    UpdateAction insert_absent(int, bool present, void *)
+    {
+        return present ? UPDATE_KEEP : UPDATE_INSERT;
+    }
+
+    UpdateAction insert_always(int, bool, void *)
+    {
+        return UPDATE_INSERT;
+    }
+
+    struct Condition
+    {
+        KeyPredicate predicate;
+        void *context;
+    };
+
+    UpdateAction erase_matching(int key, bool present, void *context)
+    {
+        Condition *condition = static_cast<Condition *>(context);
+        bool erase = present && (condition->predicate == nullptr || condition->predicate(key, condition->context));
+        return erase ? UPDATE_ERASE : UPDATE_KEEP;
+    }
+} // namespace
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key, callback, its context
+OPERATION   : Single-descent read-modify-write of key: the callback
+sees whether key is in the tree and returns whether to
+keep, insert or erase it, see update_node(). The root stays
+the root, as with delete_node().
+@return true if the tree changed.
+************************************************************* */
+bool update(Node *node, int key, UpdateFunction function, void *context)
+{
+    STAT_TIMER(STAT_OP_UPDATE, true);
+    write_begin(node);
+    feed_begin(node);
+    Change change = update_node(node, key, function, context);
+    feed_end();
+    write_end(node);
+    return change != CHANGE_NONE;
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key to insert
+OPERATION   : Insert key unless it is present, in one descent,
+instead of find_node() followed by insert_node().
+@return true if key was inserted.
+************************************************************* */
+bool try_insert(Node *node, int key)
+{
+    return update(node, key, insert_absent, nullptr);
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key
+OPERATION   : Insert key, or assign it if present. With the key as
+its only payload an assignment leaves the tree as it is,
+so this is try_insert() for callers written against maps.
+@return true if key was inserted, false if assigned.
+************************************************************* */
+bool insert_or_assign(Node *node, int key)
+{
+    return update(node, key, insert_always, nullptr);
+}
+
+/** ************************************************************
+INPUT       : Root node pointer, integer key, predicate on the key,
+its context
+OPERATION   : Erase key if it is present and the predicate, called
+at its leaf, agrees; a null predicate always does.
+@return true if key was erased.
+************************************************************* */
+bool erase_if(Node *node, int key, KeyPredicate predicate, void *context)
+{
+    Condition condition = {predicate, context};
+    return update(node, key, erase_matching, &condition);
+}
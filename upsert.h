@@ -0,0 +1,33 @@
+#pragma once
+
+#include "node.h"
+
+namespace Tree
+{
+    /** What update() does with the key, decided by its callback from
+      * whether the key is in the tree.
+      */
+    enum UpdateAction
+    {
+        UPDATE_KEEP,
+        UPDATE_INSERT, // insert, or assign if present
+        UPDATE_ERASE
+    };
+
+    /** Read-modify-write callback of update(), called once, at the
+      * leaf, with the writer lock held.
+      */
+    typedef UpdateAction (*UpdateFunction)(int key, bool present, void *context);
+
+    typedef bool (*KeyPredicate)(int key, void *context);
+} // namespace Tree
+
+using namespace Tree;
+
+bool update(Node* node, int key, UpdateFunction function, void* context);
+
+bool try_insert(Node* node, int key);
+
+bool insert_or_assign(Node* node, int key);
+
+bool erase_if(Node* node, int key, KeyPredicate predicate, void* context);